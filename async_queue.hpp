@@ -0,0 +1,231 @@
+#pragma once
+#include <coroutine>
+#include <optional>
+#include "queue.hpp"
+
+// coroutine version of the queue. needs C++20.
+// everything in here is single threaded on purpose: the queue, the producers and the consumers
+// all live on the thread that runs the executor. no locks and no atomics, a waiting consumer is
+// handed the value directly and resumed on the same thread.
+namespace nstd {
+
+    // the smallest executor that can drive the async queue. a ring of coroutine handles that
+    // get resumed in the order they were posted. run() returns when there is nothing left to do.
+    struct executor {
+    private:
+        queue<std::coroutine_handle<>> ready_;
+
+    public:
+        executor() {}
+
+        executor(const executor& ex) = delete;
+        executor& operator=(const executor& ex) = delete;
+
+        void post(std::coroutine_handle<> handle) {
+            ready_.push_back(handle);
+        }
+
+        bool run_one() {
+            if (ready_.empty()) return false;
+
+            std::coroutine_handle<> handle = ready_.front();
+            ready_.pop();
+            handle.resume();
+            return true;
+        }
+
+        void run() {
+            while (run_one()) {}
+        }
+    };
+
+    // fire and forget coroutine. starts suspended so it can be handed to an executor with spawn()
+    // and frees its own frame when it finishes.
+    struct async_task {
+        struct promise_type {
+            async_task get_return_object() noexcept { return async_task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() noexcept {}
+            void unhandled_exception() noexcept { abort(); }
+        };
+
+        std::coroutine_handle<promise_type> handle_;
+
+        explicit async_task(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+    };
+
+    inline void spawn(executor& ex, async_task task) {
+        ex.post(task.handle_);
+    }
+
+    // co_await q.pop() suspends when the queue is empty. push_back hands the value straight to the
+    // oldest waiting consumer instead of going through the ring.
+    // bound == 0 is unbounded. with a bound, co_await q.push(value) suspends the producer when full.
+    // waiters are kept in intrusive lists of awaiters, which live in the suspended coroutine frames.
+    template <class T, typename INT_TYPE = int>
+    struct async_queue {
+    private:
+        struct pop_awaiter;
+        struct push_awaiter;
+
+        executor& executor_;
+        queue<T, INT_TYPE> items_;
+        INT_TYPE bound_ = 0;
+
+        pop_awaiter* consumers_front_ = nullptr;
+        pop_awaiter* consumers_back_ = nullptr;
+        push_awaiter* producers_front_ = nullptr;
+        push_awaiter* producers_back_ = nullptr;
+
+        template<class W>
+        static void waiter_push(W*& front, W*& back, W* waiter) {
+            waiter->next_ = nullptr;
+            if (back == nullptr) front = waiter;
+            else back->next_ = waiter;
+            back = waiter;
+        }
+
+        template<class W>
+        static W* waiter_pop(W*& front, W*& back) {
+            W* waiter = front;
+            front = waiter->next_;
+            if (front == nullptr) back = nullptr;
+            return waiter;
+        }
+
+        bool full() const noexcept {
+            return bound_ != 0 && items_.size() >= bound_;
+        }
+
+        struct pop_awaiter {
+            async_queue* queue_;
+            std::coroutine_handle<> handle_;
+            std::optional<T> value_;
+            pop_awaiter* next_ = nullptr;
+
+            explicit pop_awaiter(async_queue* queue) : queue_(queue) {}
+
+            bool await_ready() const noexcept {
+                return !queue_->items_.empty();
+            }
+
+            void await_suspend(std::coroutine_handle<> handle) {
+                handle_ = handle;
+                waiter_push(queue_->consumers_front_, queue_->consumers_back_, this);
+            }
+
+            T await_resume() {
+                // handed over directly by a producer
+                if (value_) return std::move(*value_);
+
+                T value = std::move(queue_->items_.front());
+                queue_->items_.pop();
+
+                // made room so let the oldest blocked producer in
+                if (queue_->producers_front_ != nullptr) {
+                    push_awaiter* producer = waiter_pop(queue_->producers_front_, queue_->producers_back_);
+                    queue_->items_.push_back(std::move(producer->value_));
+                    queue_->executor_.post(producer->handle_);
+                }
+                return value;
+            }
+        };
+
+        struct push_awaiter {
+            async_queue* queue_;
+            std::coroutine_handle<> handle_;
+            T value_;
+            push_awaiter* next_ = nullptr;
+
+            push_awaiter(async_queue* queue, T&& value) : queue_(queue), value_(std::move(value)) {}
+
+            bool await_ready() {
+                if (queue_->consumers_front_ != nullptr || queue_->full()) return false;
+
+                queue_->items_.push_back(std::move(value_));
+                return true;
+            }
+
+            // symmetric transfer: the producer is put back on the executor and
+            // the consumer runs right now on this thread, without growing the stack
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> handle) {
+                handle_ = handle;
+
+                if (queue_->consumers_front_ != nullptr) {
+                    pop_awaiter* consumer = waiter_pop(queue_->consumers_front_, queue_->consumers_back_);
+                    consumer->value_.emplace(std::move(value_));
+                    queue_->executor_.post(handle);
+                    return consumer->handle_;
+                }
+
+                waiter_push(queue_->producers_front_, queue_->producers_back_, this);
+                return std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+        };
+
+    public:
+
+        explicit async_queue(executor& ex, INT_TYPE bound = 0) : executor_(ex), bound_(bound) {}
+
+        async_queue(const async_queue& queue) = delete;
+        async_queue& operator=(const async_queue& queue) = delete;
+
+        ~async_queue() {
+            // destroying the queue with suspended coroutines leaves them hanging forever
+            assert(consumers_front_ == nullptr && producers_front_ == nullptr);
+        }
+
+        // from a coroutine: co_await q.push(value). suspends while a bounded queue is full
+        push_awaiter push(T data) {
+            return push_awaiter(this, std::move(data));
+        }
+
+        // from anywhere: a waiting consumer is resumed inline before this returns.
+        // returns false if the queue is bounded and full, use push() to wait for room instead
+        bool try_push_back(T data) {
+            if (consumers_front_ != nullptr) {
+                pop_awaiter* consumer = waiter_pop(consumers_front_, consumers_back_);
+                consumer->value_.emplace(std::move(data));
+                consumer->handle_.resume();
+                return true;
+            }
+
+            if (full()) return false;
+
+            items_.push_back(std::move(data));
+            return true;
+        }
+
+        void push_back(const T& data) {
+            bool pushed = try_push_back(T(data));
+            assert(pushed && "bounded async_queue is full, co_await push() instead");
+            (void)pushed;
+        }
+
+        void push_back(T&& data) {
+            bool pushed = try_push_back(std::move(data));
+            assert(pushed && "bounded async_queue is full, co_await push() instead");
+            (void)pushed;
+        }
+
+        // co_await q.pop() returns the value
+        pop_awaiter pop() {
+            return pop_awaiter(this);
+        }
+
+        INT_TYPE size() const noexcept {
+            return items_.size();
+        }
+
+        bool empty() const noexcept {
+            return items_.empty();
+        }
+
+        INT_TYPE bound() const noexcept {
+            return bound_;
+        }
+    };
+}
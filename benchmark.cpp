@@ -0,0 +1,868 @@
+// benchmarks for the queues. nothing fancy, build it with optimisations on:
+// g++ -O2 -std=c++20 -pthread benchmark.cpp -o benchmark
+// ./benchmark          runs everything
+// ./benchmark async    runs the benchmarks whose name starts with "async"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "queue.hpp"
+#include "async_queue.hpp"
+#include "sharded_queue.hpp"
+#include "spsc_queue.hpp"
+#include "broadcast_queue.hpp"
+#include "concurrent_queue.hpp"
+#include "compressed_queue.hpp"
+#include "queue_algorithm.hpp"
+#include "queue_parallel.hpp"
+#include "window_aggregator.hpp"
+#include "wal_queue.hpp"
+#include "queue_sojourn.hpp"
+
+static int64_t NowNs() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// stops the optimiser from throwing away results we never look at
+template<class T>
+static void DoNotOptimise(const T& value) {
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// push -> resume latency of the async queue on a single threaded executor.
+// every message carries the time it was pushed, the consumer measures how long it took to wake up.
+struct AsyncLatency {
+	int64_t total_ns = 0;
+	int64_t max_ns = 0;
+	int count = 0;
+
+	void add(int64_t ns) {
+		total_ns += ns;
+		if (ns > max_ns) max_ns = ns;
+		++count;
+	}
+};
+
+static nstd::async_task AsyncConsumer(nstd::async_queue<int64_t>& q, AsyncLatency& latency, int messages) {
+	for (int i = 0; i < messages; i++) {
+		int64_t pushed_at = co_await q.pop();
+		latency.add(NowNs() - pushed_at);
+	}
+}
+
+static nstd::async_task AsyncProducer(nstd::async_queue<int64_t>& q, int messages) {
+	for (int i = 0; i < messages; i++) {
+		co_await q.push(NowNs());
+	}
+}
+
+static void BenchmarkAsyncQueue() {
+	const int messages = 1000000;
+
+	// consumer is always waiting, push_back from plain code resumes it inline
+	{
+		nstd::executor ex;
+		nstd::async_queue<int64_t> q(ex);
+		AsyncLatency latency;
+
+		nstd::spawn(ex, AsyncConsumer(q, latency, messages));
+		ex.run();
+
+		int64_t start = NowNs();
+		for (int i = 0; i < messages; i++) {
+			q.push_back(NowNs());
+		}
+		int64_t elapsed = NowNs() - start;
+
+		printf("async push_back -> resume:      avg %6.1f ns  max %8lld ns  (%.1f M msg/s)\n",
+			(double)latency.total_ns / latency.count, (long long)latency.max_ns, messages * 1e3 / elapsed);
+	}
+
+	// producer coroutine, symmetric transfer into the waiting consumer
+	{
+		nstd::executor ex;
+		nstd::async_queue<int64_t> q(ex);
+		AsyncLatency latency;
+
+		nstd::spawn(ex, AsyncConsumer(q, latency, messages));
+		nstd::spawn(ex, AsyncProducer(q, messages));
+
+		int64_t start = NowNs();
+		ex.run();
+		int64_t elapsed = NowNs() - start;
+
+		printf("async co_await push -> resume:  avg %6.1f ns  max %8lld ns  (%.1f M msg/s)\n",
+			(double)latency.total_ns / latency.count, (long long)latency.max_ns, messages * 1e3 / elapsed);
+	}
+
+	// bounded, the producer runs ahead until the queue is full and then has to wait
+	{
+		nstd::executor ex;
+		nstd::async_queue<int64_t> q(ex, 64);
+		AsyncLatency latency;
+
+		nstd::spawn(ex, AsyncProducer(q, messages));
+		nstd::spawn(ex, AsyncConsumer(q, latency, messages));
+
+		int64_t start = NowNs();
+		ex.run();
+		int64_t elapsed = NowNs() - start;
+
+		printf("async bounded(64) push -> pop:  avg %6.1f ns  max %8lld ns  (%.1f M msg/s)\n",
+			(double)latency.total_ns / latency.count, (long long)latency.max_ns, messages * 1e3 / elapsed);
+	}
+}
+
+// runs the same work on 1, 2, 4 ... threads and prints millions of operations per second for each
+template<class Work>
+static void ScaleThreads(const char* label, int ops_per_thread, Work work) {
+	int max_threads = (int)std::thread::hardware_concurrency();
+	if (max_threads <= 0) max_threads = 1;
+
+	for (int threads = 1; threads <= max_threads; threads *= 2) {
+		std::vector<std::thread> workers;
+		int64_t start = NowNs();
+		for (int t = 0; t < threads; t++) {
+			workers.emplace_back([&work, ops_per_thread]() { work(ops_per_thread); });
+		}
+		for (std::thread& worker : workers) worker.join();
+		int64_t elapsed = NowNs() - start;
+
+		printf("%-32s %3d threads  %8.1f M ops/s\n", label, threads, (double)threads * ops_per_thread * 1e3 / elapsed);
+	}
+}
+
+// every thread pushes a burst and pops it back. the sharded queue keeps that on the local core,
+// the mutex queue makes every thread fight over one lock
+static void BenchmarkShardedQueue() {
+	const int ops_per_thread = 2000000;
+	const int burst = 64;
+
+	{
+		nstd::sharded_queue<int> q;
+		ScaleThreads("sharded_queue push/pop", ops_per_thread, [&q](int ops) {
+			int value = 0;
+			for (int i = 0; i < ops; i += burst * 2) {
+				for (int j = 0; j < burst; j++) q.push_back(j);
+				for (int j = 0; j < burst; j++) q.try_pop(value);
+			}
+			DoNotOptimise(value);
+		});
+	}
+
+	{
+		std::mutex mutex;
+		nstd::queue<int> q;
+		ScaleThreads("mutex + nstd::queue push/pop", ops_per_thread, [&q, &mutex](int ops) {
+			int value = 0;
+			for (int i = 0; i < ops; i += burst * 2) {
+				for (int j = 0; j < burst; j++) {
+					std::lock_guard<std::mutex> lock(mutex);
+					q.push_back(j);
+				}
+				for (int j = 0; j < burst; j++) {
+					std::lock_guard<std::mutex> lock(mutex);
+					if (!q.empty()) { value = q.front(); q.pop(); }
+				}
+			}
+			DoNotOptimise(value);
+		});
+	}
+
+	// threads alternate between only pushing and only popping, so the poppers have to steal everything
+	{
+		nstd::sharded_queue<int> q;
+		ScaleThreads("sharded_queue steal", ops_per_thread, [&q](int ops) {
+			static std::atomic<int> role{ 0 };
+			int value = 0;
+			if (role.fetch_add(1) % 2 == 0) {
+				for (int i = 0; i < ops; i++) q.push_back(i);
+			}
+			else {
+				for (int i = 0; i < ops; i++) q.try_pop(value);
+			}
+			DoNotOptimise(value);
+		});
+	}
+}
+
+// one producer thread and one consumer thread moving 64 bit values through the spsc ring.
+// batch 0 is the one-at-a-time try_push/try_pop, otherwise claim/commit and peek/release of up to batch elements
+static void BenchmarkSpscBatch() {
+	const int64_t messages = 50000000;
+	const size_t batches[] = { 0, 1, 4, 16, 64, 256, 1024 };
+
+	for (size_t batch : batches) {
+		nstd::spsc_queue<int64_t> q(65536);
+		int64_t sum = 0;
+
+		int64_t start = NowNs();
+		std::thread consumer([&q, &sum, batch, messages]() {
+			int64_t received = 0;
+			while (received < messages) {
+				if (batch == 0) {
+					int64_t value;
+					if (q.try_pop(value)) { sum += value; ++received; }
+					else std::this_thread::yield();
+					continue;
+				}
+
+				nstd::segments<int64_t, size_t> readable = q.peek(batch);
+				if (readable.size() == 0) { std::this_thread::yield(); continue; }
+
+				for (int64_t value : readable.first) sum += value;
+				for (int64_t value : readable.second) sum += value;
+				q.release(readable.size());
+				received += readable.size();
+			}
+		});
+
+		int64_t sent = 0;
+		while (sent < messages) {
+			if (batch == 0) {
+				if (q.try_push(sent)) ++sent;
+				else std::this_thread::yield();
+				continue;
+			}
+
+			size_t want = batch;
+			if ((int64_t)want > messages - sent) want = (size_t)(messages - sent);
+
+			nstd::segments<int64_t, size_t> writable = q.claim(want);
+			if (writable.size() == 0) { std::this_thread::yield(); continue; }
+
+			for (int64_t& slot : writable.first) slot = sent++;
+			for (int64_t& slot : writable.second) slot = sent++;
+			q.commit(writable.size());
+		}
+
+		consumer.join();
+		int64_t elapsed = NowNs() - start;
+		DoNotOptimise(sum);
+
+		if (batch == 0) printf("spsc try_push/try_pop          %8.1f M msg/s\n", messages * 1e3 / elapsed);
+		else printf("spsc claim/commit batch %-5zu  %8.1f M msg/s\n", batch, messages * 1e3 / elapsed);
+	}
+}
+
+// one producer, three readers that all need every message. the broadcast ring writes each message once,
+// the alternative is one spsc ring per reader and a copy of every message into each of them
+struct Message {
+	int64_t sequence;
+	int64_t payload[7];
+};
+
+static void BenchmarkBroadcast() {
+	const int64_t messages = 10000000;
+	const int readers = 3;
+	const size_t batch = 64;
+
+	{
+		nstd::broadcast_queue<Message> q(65536, readers);
+		std::vector<std::thread> threads;
+		std::atomic<int> ready{ 0 };
+
+		for (int r = 0; r < readers; r++) {
+			nstd::broadcast_reader<Message> reader = q.add_reader();
+			threads.emplace_back([reader, messages, &ready]() mutable {
+				int64_t sum = 0;
+				int64_t received = 0;
+				ready.fetch_add(1);
+				while (received < messages) {
+					nstd::segments<const Message, size_t> readable = reader.peek(batch);
+					if (readable.size() == 0) { std::this_thread::yield(); continue; }
+
+					for (size_t i = 0; i < readable.size(); i++) sum += readable[i].sequence;
+					reader.release(readable.size());
+					received += readable.size();
+				}
+				DoNotOptimise(sum);
+			});
+		}
+		while (ready.load() != readers) std::this_thread::yield();
+
+		int64_t start = NowNs();
+		int64_t sent = 0;
+		while (sent < messages) {
+			nstd::segments<Message, size_t> writable = q.claim(batch);
+			if (writable.size() == 0) { std::this_thread::yield(); continue; }
+
+			size_t n = writable.size();
+			if ((int64_t)n > messages - sent) n = (size_t)(messages - sent);
+			for (size_t i = 0; i < n; i++) writable[i].sequence = sent++;
+			q.commit(n);
+		}
+		for (std::thread& thread : threads) thread.join();
+		int64_t elapsed = NowNs() - start;
+
+		printf("broadcast_queue 1 -> %d readers      %8.1f M msg/s\n", readers, messages * 1e3 / elapsed);
+	}
+
+	{
+		std::vector<nstd::spsc_queue<Message>*> queues;
+		std::vector<std::thread> threads;
+		for (int r = 0; r < readers; r++) queues.push_back(new nstd::spsc_queue<Message>(65536));
+
+		for (int r = 0; r < readers; r++) {
+			nstd::spsc_queue<Message>* q = queues[r];
+			threads.emplace_back([q, messages]() {
+				int64_t sum = 0;
+				int64_t received = 0;
+				while (received < messages) {
+					nstd::segments<Message, size_t> readable = q->peek(batch);
+					if (readable.size() == 0) { std::this_thread::yield(); continue; }
+
+					for (size_t i = 0; i < readable.size(); i++) sum += readable[i].sequence;
+					q->release(readable.size());
+					received += readable.size();
+				}
+				DoNotOptimise(sum);
+			});
+		}
+
+		int64_t start = NowNs();
+		Message message = {};
+		for (int64_t sent = 0; sent < messages; sent++) {
+			message.sequence = sent;
+			for (nstd::spsc_queue<Message>* q : queues) {
+				while (!q->try_push(message)) std::this_thread::yield();
+			}
+		}
+		for (std::thread& thread : threads) thread.join();
+		int64_t elapsed = NowNs() - start;
+
+		for (nstd::spsc_queue<Message>* q : queues) delete q;
+		printf("%d x spsc_queue copies              %8.1f M msg/s\n", readers, messages * 1e3 / elapsed);
+	}
+}
+
+// half the threads push, half pop, with bursts of pushes so the queue has to keep growing and shrinking.
+// push and pop are whatever the queue under test needs, pop returns false when it found the queue empty
+template<class Push, class Pop>
+static void RunProducersConsumers(const char* label, int64_t per_producer, Push push, Pop pop) {
+	int max_threads = (int)std::thread::hardware_concurrency();
+	if (max_threads < 2) max_threads = 2;
+
+	for (int pairs = 1; pairs * 2 <= max_threads; pairs *= 2) {
+		std::atomic<int64_t> popped{ 0 };
+		const int64_t total = per_producer * pairs;
+		std::vector<std::thread> workers;
+
+		int64_t start = NowNs();
+		for (int p = 0; p < pairs; p++) {
+			workers.emplace_back([&push, per_producer]() {
+				for (int64_t i = 0; i < per_producer; i++) {
+					push(i);
+					// bursty: every so often hand the core to the consumers
+					if ((i & 0xffff) == 0) std::this_thread::yield();
+				}
+			});
+			workers.emplace_back([&pop, &popped, total]() {
+				int64_t value = 0;
+				while (popped.load(std::memory_order_relaxed) < total) {
+					if (pop(value)) popped.fetch_add(1, std::memory_order_relaxed);
+					else std::this_thread::yield();
+				}
+				DoNotOptimise(value);
+			});
+		}
+		for (std::thread& worker : workers) worker.join();
+		int64_t elapsed = NowNs() - start;
+
+		printf("%-36s %3d producers %3d consumers  %8.1f M ops/s\n", label, pairs, pairs, total * 2 * 1e3 / elapsed);
+	}
+}
+
+static void BenchmarkConcurrentQueue() {
+	const int64_t per_producer = 4000000;
+
+	{
+		nstd::concurrent_queue<int64_t> q(64);
+		RunProducersConsumers("concurrent_queue (doubling rings)", per_producer,
+			[&q](int64_t value) { q.push_back(value); },
+			[&q](int64_t& value) { return q.try_pop(value); });
+	}
+
+	{
+		nstd::concurrent_queue<int64_t> q(1024, 1024);
+		RunProducersConsumers("concurrent_queue (fixed 1024 rings)", per_producer,
+			[&q](int64_t value) { q.push_back(value); },
+			[&q](int64_t& value) { return q.try_pop(value); });
+	}
+
+	{
+		std::mutex mutex;
+		nstd::queue<int64_t> q;
+		RunProducersConsumers("mutex + nstd::queue", per_producer,
+			[&q, &mutex](int64_t value) { std::lock_guard<std::mutex> lock(mutex); q.push_back(value); },
+			[&q, &mutex](int64_t& value) {
+				std::lock_guard<std::mutex> lock(mutex);
+				if (q.empty()) return false;
+				value = q.front();
+				q.pop();
+				return true;
+			});
+	}
+}
+
+// timestamps a few microseconds apart, the case compressed_queue is for. memory per value and how fast
+// they can be pushed and drained compared to keeping them as plain int64_t in a queue_trivial
+static void BenchmarkCompressedQueue() {
+	const int count = 20000000;
+
+	{
+		nstd::compressed_queue<int64_t> q;
+		int64_t timestamp = 1700000000000000000;
+
+		int64_t start = NowNs();
+		for (int i = 0; i < count; i++) {
+			timestamp += 1000 + ((int64_t)i * 7919) % 4000;
+			q.push_back(timestamp);
+		}
+		int64_t pushed = NowNs();
+		double bytes = (double)q.memory_bytes() / count;
+
+		uint64_t sum = 0;
+		q.drain([&sum](const int64_t* values, int n) {
+			for (int i = 0; i < n; i++) sum += (uint64_t)values[i];
+		});
+		int64_t drained = NowNs();
+		DoNotOptimise(sum);
+
+		printf("compressed_queue<int64_t>   %5.2f bytes/value  push %6.2f ns  drain %6.2f ns\n",
+			bytes, (double)(pushed - start) / count, (double)(drained - pushed) / count);
+	}
+
+	{
+		nstd::queue_trivial<int64_t> q;
+		int64_t timestamp = 1700000000000000000;
+
+		int64_t start = NowNs();
+		for (int i = 0; i < count; i++) {
+			timestamp += 1000 + ((int64_t)i * 7919) % 4000;
+			q.push_back(timestamp);
+		}
+		int64_t pushed = NowNs();
+		double bytes = (double)sizeof(int64_t) * q.capacity() / count;
+
+		uint64_t sum = 0;
+		while (!q.empty()) {
+			sum += (uint64_t)q.front();
+			q.pop();
+		}
+		int64_t drained = NowNs();
+		DoNotOptimise(sum);
+
+		printf("queue_trivial<int64_t>      %5.2f bytes/value  push %6.2f ns  drain %6.2f ns\n",
+			bytes, (double)(pushed - start) / count, (double)(drained - pushed) / count);
+	}
+}
+
+// the algorithms over segments against the same loop through operator[], which pays a modulo per element.
+// the queue is wrapped so both pieces are used
+template<class T>
+static void BenchmarkAlgorithmsFor(const char* name) {
+	const int count = 1 << 20;
+	const int rounds = 50;
+
+	nstd::queue_trivial<T> q;
+	q.reserve(count);
+	for (int i = 0; i < count / 2; i++) q.push_back(T());
+	for (int i = 0; i < count / 2; i++) q.pop();
+	for (int i = 0; i < count - 1; i++) q.push_back((T)(i % 1000));
+
+	int64_t start = NowNs();
+	for (int r = 0; r < rounds; r++) {
+		T sum = T();
+		for (int i = 0; i < q.size(); i++) sum += q[i];
+		DoNotOptimise(sum);
+	}
+	int64_t indexed_sum = NowNs() - start;
+
+	start = NowNs();
+	for (int r = 0; r < rounds; r++) DoNotOptimise(nstd::sum(q));
+	int64_t segments_sum = NowNs() - start;
+
+	start = NowNs();
+	for (int r = 0; r < rounds; r++) {
+		T result = q[0];
+		for (int i = 1; i < q.size(); i++) result = q[i] < result ? q[i] : result;
+		DoNotOptimise(result);
+	}
+	int64_t indexed_min = NowNs() - start;
+
+	start = NowNs();
+	for (int r = 0; r < rounds; r++) DoNotOptimise(nstd::min(q));
+	int64_t segments_min = NowNs() - start;
+
+	// not in the queue, so the whole thing is searched
+	const T missing = (T)-1;
+	start = NowNs();
+	for (int r = 0; r < rounds; r++) {
+		int found = q.size();
+		for (int i = 0; i < q.size(); i++) {
+			if (q[i] == missing) {
+				found = i;
+				break;
+			}
+		}
+		DoNotOptimise(found);
+	}
+	int64_t indexed_find = NowNs() - start;
+
+	start = NowNs();
+	for (int r = 0; r < rounds; r++) DoNotOptimise(nstd::find(q, missing));
+	int64_t segments_find = NowNs() - start;
+
+	double per = 1.0 / ((double)rounds * q.size());
+	printf("%-8s sum %6.3f -> %6.3f ns  min %6.3f -> %6.3f ns  find %6.3f -> %6.3f ns\n", name,
+		indexed_sum * per, segments_sum * per, indexed_min * per, segments_min * per, indexed_find * per, segments_find * per);
+}
+
+static void BenchmarkAlgorithms() {
+#if defined(NSTD_QUEUE_AVX2)
+	printf("avx2 %s\n", nstd::has_avx2() ? "yes" : "no");
+#endif
+	BenchmarkAlgorithmsFor<float>("float");
+	BenchmarkAlgorithmsFor<double>("double");
+	BenchmarkAlgorithmsFor<int32_t>("int32_t");
+	BenchmarkAlgorithmsFor<int64_t>("int64_t");
+}
+
+// transform_inplace and reduce over 10M floats on 1 to 32 threads. the single thread line
+// is the sequenced policy, the rest use par with an explicit thread count
+static void BenchmarkParallel() {
+	const int count = 10000000;
+	const int rounds = 10;
+
+	nstd::queue_trivial<float> q;
+	q.reserve(count);
+	for (int i = 0; i < count / 3; i++) q.push_back(0.0f);
+	for (int i = 0; i < count / 3; i++) q.pop();
+	for (int i = 0; i < count - 1; i++) q.push_back((float)(i % 1000));
+
+	printf("hardware threads %u\n", std::thread::hardware_concurrency());
+	for (int threads = 1; threads <= 32; threads *= 2) {
+		int64_t start = NowNs();
+		for (int r = 0; r < rounds; r++) {
+			auto scale = [](float v) { return v * 0.5f + 1.0f; };
+			if (threads == 1) nstd::transform_inplace(nstd::execution::seq, q, scale);
+			else nstd::transform_inplace(nstd::execution::par, q, scale, threads);
+		}
+		int64_t transformed = NowNs();
+
+		for (int r = 0; r < rounds; r++) {
+			float sum;
+			if (threads == 1) sum = nstd::reduce(nstd::execution::seq, q, 0.0f);
+			else sum = nstd::reduce(nstd::execution::par, q, 0.0f, threads);
+			DoNotOptimise(sum);
+		}
+		int64_t reduced = NowNs();
+
+		double per = 1.0 / ((double)rounds * q.size());
+		printf("%2d threads  transform_inplace %6.3f ns  reduce %6.3f ns\n", threads,
+			(transformed - start) * per, (reduced - transformed) * per);
+	}
+}
+
+// ticks for timing one operation. rdtsc where there is one, it costs a lot less than reading the clock
+static inline uint64_t Ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+	_mm_lfence();
+	return __rdtsc();
+#else
+	return (uint64_t)NowNs();
+#endif
+}
+
+static double TicksPerNs() {
+	static double ticks_per_ns = 0;
+	if (ticks_per_ns == 0) {
+		int64_t start_ns = NowNs();
+		uint64_t start = Ticks();
+		while (NowNs() - start_ns < 50000000) {}
+		ticks_per_ns = (double)(Ticks() - start) / (NowNs() - start_ns);
+	}
+	return ticks_per_ns;
+}
+
+// HDR style histogram of tick counts, the same log_histogram queue_sojourn uses but with 32 linear steps per
+// power of two, so every value is kept to within about 3% without storing them all
+struct TickHistogram {
+	nstd::basic_log_histogram<5> ticks;
+
+	void Add(uint64_t value) {
+		ticks.add(value);
+	}
+
+	void Print(const char* label) const {
+		double per_ns = TicksPerNs();
+		printf("%-42s p50 %7.1f  p99 %7.1f  p99.9 %9.1f  max %11.1f ns\n", label,
+			ticks.percentile(50) / per_ns, ticks.percentile(99) / per_ns, ticks.percentile(99.9) / per_ns,
+			ticks.max() / per_ns);
+	}
+};
+
+// every push_back and pop timed on its own. growing is where the doubling shows up, a queue that was
+// reserved first never reallocates (but still page faults the first time it writes to each page),
+// steady state keeps the size constant with a push and a pop per step.
+// the numbers include the cost of reading the ticks twice, which is the floor of the p50
+template<class Queue>
+static void LatencyFor(const char* name) {
+	const int count = 4000000;
+	char label[128];
+
+	// growing from empty
+	{
+		TickHistogram push;
+		TickHistogram pop;
+		Queue q;
+		for (int i = 0; i < count; i++) {
+			uint64_t start = Ticks();
+			q.push_back(i);
+			push.Add(Ticks() - start);
+		}
+		for (int i = 0; i < count; i++) {
+			uint64_t start = Ticks();
+			q.pop();
+			pop.Add(Ticks() - start);
+		}
+		snprintf(label, sizeof(label), "%s growing push_back", name);
+		push.Print(label);
+		snprintf(label, sizeof(label), "%s growing pop", name);
+		pop.Print(label);
+	}
+
+	// reserved up front
+	{
+		TickHistogram push;
+		Queue q;
+		q.reserve(count);
+		for (int i = 0; i < count; i++) {
+			uint64_t start = Ticks();
+			q.push_back(i);
+			push.Add(Ticks() - start);
+		}
+		snprintf(label, sizeof(label), "%s reserved push_back", name);
+		push.Print(label);
+	}
+
+	// steady state at 64k elements
+	{
+		TickHistogram push;
+		TickHistogram pop;
+		Queue q;
+		for (int i = 0; i < 65536; i++) q.push_back(i);
+		for (int i = 0; i < count; i++) {
+			uint64_t start = Ticks();
+			q.push_back(i);
+			uint64_t pushed = Ticks();
+			q.pop();
+			uint64_t popped = Ticks();
+			push.Add(pushed - start);
+			pop.Add(popped - pushed);
+		}
+		snprintf(label, sizeof(label), "%s steady push_back", name);
+		push.Print(label);
+		snprintf(label, sizeof(label), "%s steady pop", name);
+		pop.Print(label);
+	}
+}
+
+static void BenchmarkLatency() {
+	printf("%.3f ticks per ns\n", TicksPerNs());
+	LatencyFor<nstd::queue<int64_t>>("queue<int64_t>");
+	LatencyFor<nstd::queue_trivial<int64_t>>("queue_trivial<int64_t>");
+}
+
+// draining a queue of 64 byte records that's far bigger than the caches, so every element comes from DRAM.
+// front()/pop() against drain() with no prefetching and with a few distances, and pushing into a reserved
+// queue with and without prefetch_back() ahead of it
+struct Record64 {
+	int64_t value;
+	int64_t payload[7];
+};
+
+static void BenchmarkPrefetch() {
+	const int count = 1 << 21; // 128 MB
+
+	nstd::queue_trivial<Record64> q;
+	q.reserve(count);
+	auto fill = [&q]() {
+		Record64 record = {};
+		for (int i = 0; i < count; i++) {
+			record.value = i;
+			q.push_back(record);
+		}
+	};
+	auto report = [](const char* label, int64_t ns, int64_t sum) {
+		DoNotOptimise(sum);
+		printf("%-32s %6.2f ns per element\n", label, (double)ns / count);
+	};
+
+	{
+		fill();
+		int64_t sum = 0;
+		int64_t start = NowNs();
+		while (!q.empty()) {
+			sum += q.front().value;
+			q.pop();
+		}
+		report("front/pop", NowNs() - start, sum);
+	}
+
+	for (int distance : { 0, 4, 8, 16, 32 }) {
+		fill();
+		int64_t sum = 0;
+		int64_t start = NowNs();
+		q.drain([&sum](Record64& record) { sum += record.value; }, distance);
+
+		char label[64];
+		snprintf(label, sizeof(label), "drain, prefetch %d ahead", distance);
+		report(label, NowNs() - start, sum);
+	}
+
+	// the pages were touched by the runs above, so this is cache misses and not page faults
+	for (int distance : { 0, 8, 16 }) {
+		q.clear();
+		Record64 record = {};
+		int64_t start = NowNs();
+		for (int i = 0; i < count; i++) {
+			if (distance > 0) q.prefetch_back(distance);
+			record.value = i;
+			q.push_back(record);
+		}
+
+		char label[64];
+		snprintf(label, sizeof(label), "push_back, prefetch_back %d", distance);
+		report(label, NowNs() - start, q[q.size() - 1].value);
+	}
+}
+
+// rolling sum of the last window values, one push and one evict per step, against recomputing the sum of the
+// window from a queue_trivial every step. recomputing is only run for a few steps on the big windows
+static void BenchmarkWindow() {
+	for (int window = 100; window <= 10000000; window *= 10) {
+		int steps = window < 1000000 ? 1000000 : window;
+
+		nstd::window_aggregator<double, nstd::window_sum<double>> sums;
+		for (int i = 0; i < window; i++) sums.push_back((double)(i % 100));
+
+		double total = 0;
+		int64_t start = NowNs();
+		for (int i = 0; i < steps; i++) {
+			sums.push_back((double)(i % 100));
+			sums.evict();
+			total += sums.query();
+		}
+		int64_t aggregated = NowNs() - start;
+		DoNotOptimise(total);
+
+		nstd::queue_trivial<double> values;
+		for (int i = 0; i < window; i++) values.push_back((double)(i % 100));
+
+		int recompute_steps = (int)(200000000ll / window);
+		if (recompute_steps < 3) recompute_steps = 3;
+		if (recompute_steps > steps) recompute_steps = steps;
+
+		total = 0;
+		start = NowNs();
+		for (int i = 0; i < recompute_steps; i++) {
+			values.push_back((double)(i % 100));
+			values.pop();
+			double sum = 0;
+			values.for_each([&sum](double& value) { sum += value; }, 0);
+			total += sum;
+		}
+		int64_t recomputed = NowNs() - start;
+		DoNotOptimise(total);
+
+		printf("window %8d  window_aggregator %8.2f ns/step  recompute %14.2f ns/step\n", window,
+			(double)aggregated / steps, (double)recomputed / recompute_steps);
+	}
+}
+
+// durable pushes per second: every thread pushes and waits for its record to be synced, so the rate is how many
+// pushes the group commit manages to share each fdatasync between. the log goes in a fresh directory under /tmp
+static void BenchmarkWal() {
+	const int pushes_per_thread = 500;
+
+	for (int window_us : { 500, 2000 }) {
+		for (int threads = 1; threads <= 8; threads *= 2) {
+			char directory[] = "/tmp/nstd_wal_XXXXXX";
+			if (mkdtemp(directory) == nullptr) {
+				printf("wal: can't make a directory under /tmp\n");
+				return;
+			}
+
+			int64_t elapsed;
+			int error;
+			{
+				nstd::wal_queue<int64_t> q{ std::chrono::microseconds(window_us) };
+				error = q.open(directory);
+				if (error != 0) {
+					printf("wal: open failed %d\n", error);
+					return;
+				}
+
+				std::vector<std::thread> workers;
+				int64_t start = NowNs();
+				for (int t = 0; t < threads; t++) {
+					workers.emplace_back([&q]() {
+						for (int i = 0; i < pushes_per_thread; i++) q.wait_durable(q.push_back(i));
+					});
+				}
+				for (std::thread& worker : workers) worker.join();
+				elapsed = NowNs() - start;
+				error = q.error();
+			}
+
+			char command[64];
+			snprintf(command, sizeof(command), "rm -rf %s", directory);
+			if (system(command) != 0) printf("wal: couldn't remove %s\n", directory);
+
+			printf("wal window %5d us  %d threads  %9.0f durable pushes/s%s\n", window_us, threads,
+				(double)threads * pushes_per_thread * 1e9 / elapsed, error != 0 ? "  (log failed)" : "");
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	struct Benchmark {
+		const char* name;
+		void (*run)();
+	};
+
+	Benchmark benchmarks[] = {
+		{ "async", BenchmarkAsyncQueue },
+		{ "sharded", BenchmarkShardedQueue },
+		{ "spsc", BenchmarkSpscBatch },
+		{ "broadcast", BenchmarkBroadcast },
+		{ "concurrent", BenchmarkConcurrentQueue },
+		{ "compressed", BenchmarkCompressedQueue },
+		{ "algorithm", BenchmarkAlgorithms },
+		{ "parallel", BenchmarkParallel },
+		{ "latency", BenchmarkLatency },
+		{ "prefetch", BenchmarkPrefetch },
+		{ "window", BenchmarkWindow },
+		{ "wal", BenchmarkWal },
+	};
+
+	const char* filter = argc > 1 ? argv[1] : "";
+	for (const Benchmark& benchmark : benchmarks) {
+		if (strncmp(benchmark.name, filter, strlen(filter)) != 0) continue;
+
+		printf("== %s\n", benchmark.name);
+		benchmark.run();
+	}
+
+	return 0;
+}
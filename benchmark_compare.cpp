@@ -0,0 +1,227 @@
+// nstd::queue and queue_trivial against std::deque, std::queue and a ring on top of std::vector.
+// prints JSON on stdout so runs can be kept and compared, progress goes to stderr.
+// g++ -O2 -std=c++20 benchmark_compare.cpp -o benchmark_compare
+// ./benchmark_compare              queues of up to 256 MB
+// ./benchmark_compare 4096         queues of up to 4096 MB
+//
+// for every container, element type and queue size it measures, in ns per element:
+// push      push_back into an empty queue up to the size, so it includes growing
+// pop       popping all of them again
+// steady    one push_back and one pop per step with the queue staying at the size
+// iterate   reading every element through operator[] (not for std::queue, it can't)
+// random    reading elements at random indices through operator[] (not for std::queue either)
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <deque>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "queue.hpp"
+
+static int64_t NowNs() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template<class T>
+static void DoNotOptimise(const T& value) {
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// the element types. each can be made from an int and read back as one, so every container runs the same code
+struct Bytes64 {
+	int64_t value;
+	char padding[56];
+};
+
+struct Bytes256 {
+	int64_t value;
+	char padding[248];
+};
+
+template<class T> static T MakeElement(int64_t i) { T element; memset(&element, 0, sizeof(element)); element.value = i; return element; }
+template<> int32_t MakeElement<int32_t>(int64_t i) { return (int32_t)i; }
+// long enough that it doesn't fit in the small string buffer, so every element has its own allocation
+template<> std::string MakeElement<std::string>(int64_t i) { return std::string(32, (char)('a' + i % 26)); }
+
+template<class T> static int64_t ReadElement(const T& element) { return element.value; }
+template<> int64_t ReadElement<int32_t>(const int32_t& element) { return element; }
+template<> int64_t ReadElement<std::string>(const std::string& element) { return element[0]; }
+
+// a ring on top of a std::vector, power of two capacity, what people usually write instead
+template<class T>
+struct VectorRing {
+	std::vector<T> buffer;
+	size_t head = 0;
+	size_t count = 0;
+
+	void push_back(T value) {
+		if (count == buffer.size()) {
+			std::vector<T> bigger(buffer.empty() ? 16 : buffer.size() * 2);
+			for (size_t i = 0; i < count; i++) bigger[i] = std::move(buffer[(head + i) & (buffer.size() - 1)]);
+			buffer.swap(bigger);
+			head = 0;
+		}
+		buffer[(head + count) & (buffer.size() - 1)] = std::move(value);
+		++count;
+	}
+
+	T& front() { return buffer[head]; }
+
+	void pop() {
+		head = (head + 1) & (buffer.size() - 1);
+		--count;
+	}
+
+	T& operator[](size_t i) { return buffer[(head + i) & (buffer.size() - 1)]; }
+	size_t size() const { return count; }
+};
+
+// the same few operations on every container
+template<class C> struct Ops {
+	static void Push(C& c, typename C::value_type value) { c.push_back(std::move(value)); }
+	static auto& Front(C& c) { return c.front(); }
+	static void Pop(C& c) { c.pop_front(); }
+	static constexpr bool indexable = true;
+};
+
+template<class T> struct Ops<nstd::queue<T>> {
+	static void Push(nstd::queue<T>& c, T value) { c.push_back(std::move(value)); }
+	static T& Front(nstd::queue<T>& c) { return c.front(); }
+	static void Pop(nstd::queue<T>& c) { c.pop(); }
+	static constexpr bool indexable = true;
+};
+
+template<class T> struct Ops<nstd::queue_trivial<T>> {
+	static void Push(nstd::queue_trivial<T>& c, T value) { c.push_back(value); }
+	static T& Front(nstd::queue_trivial<T>& c) { return c.front(); }
+	static void Pop(nstd::queue_trivial<T>& c) { c.pop(); }
+	static constexpr bool indexable = true;
+};
+
+template<class T> struct Ops<std::queue<T>> {
+	static void Push(std::queue<T>& c, T value) { c.push(std::move(value)); }
+	static T& Front(std::queue<T>& c) { return c.front(); }
+	static void Pop(std::queue<T>& c) { c.pop(); }
+	static constexpr bool indexable = false;
+};
+
+template<class T> struct Ops<VectorRing<T>> {
+	static void Push(VectorRing<T>& c, T value) { c.push_back(std::move(value)); }
+	static T& Front(VectorRing<T>& c) { return c.front(); }
+	static void Pop(VectorRing<T>& c) { c.pop(); }
+	static constexpr bool indexable = true;
+};
+
+static bool first_result = true;
+
+static void Report(const char* container, const char* element, size_t element_bytes, int64_t elements, const char* op, double ns) {
+	printf("%s\n    {\"container\": \"%s\", \"element\": \"%s\", \"element_bytes\": %zu, \"elements\": %lld, \"bytes\": %lld, \"op\": \"%s\", \"ns_per_element\": %.4f}",
+		first_result ? "" : ",", container, element, element_bytes, (long long)elements, (long long)(elements * (int64_t)element_bytes), op, ns);
+	first_result = false;
+}
+
+template<class C, class T>
+static void Run(const char* container, const char* element, int64_t elements) {
+	using O = Ops<C>;
+
+	// small queues are run several times so every measurement covers at least a few million elements
+	int64_t rounds = ((int64_t)1 << 22) / elements;
+	if (rounds < 1) rounds = 1;
+
+	// made up front so the string allocations aren't part of the timings
+	int64_t pool = elements < 4096 ? elements : 4096;
+	std::vector<T> values;
+	for (int64_t i = 0; i < pool; i++) values.push_back(MakeElement<T>(i));
+	int64_t mask = pool - 1;
+
+	int64_t push_ns = 0;
+	int64_t pop_ns = 0;
+	int64_t sink = 0;
+	for (int64_t r = 0; r < rounds; r++) {
+		C c;
+		int64_t start = NowNs();
+		for (int64_t i = 0; i < elements; i++) O::Push(c, values[i & mask]);
+		int64_t pushed = NowNs();
+		for (int64_t i = 0; i < elements; i++) {
+			sink += ReadElement(O::Front(c));
+			O::Pop(c);
+		}
+		int64_t popped = NowNs();
+		push_ns += pushed - start;
+		pop_ns += popped - pushed;
+	}
+	Report(container, element, sizeof(T), elements, "push", (double)push_ns / (rounds * elements));
+	Report(container, element, sizeof(T), elements, "pop", (double)pop_ns / (rounds * elements));
+
+	C c;
+	for (int64_t i = 0; i < elements; i++) O::Push(c, values[i & mask]);
+
+	int64_t steps = rounds * elements;
+	int64_t start = NowNs();
+	for (int64_t i = 0; i < steps; i++) {
+		O::Push(c, values[i & mask]);
+		sink += ReadElement(O::Front(c));
+		O::Pop(c);
+	}
+	Report(container, element, sizeof(T), elements, "steady", (double)(NowNs() - start) / steps);
+
+	if constexpr (O::indexable) {
+		start = NowNs();
+		for (int64_t r = 0; r < rounds; r++) {
+			for (int64_t i = 0; i < elements; i++) sink += ReadElement(c[i]);
+		}
+		Report(container, element, sizeof(T), elements, "iterate", (double)(NowNs() - start) / steps);
+
+		uint64_t state = 88172645463325252ull;
+		start = NowNs();
+		for (int64_t i = 0; i < steps; i++) {
+			state ^= state << 13;
+			state ^= state >> 7;
+			state ^= state << 17;
+			sink += ReadElement(c[(int64_t)(state % (uint64_t)elements)]);
+		}
+		Report(container, element, sizeof(T), elements, "random", (double)(NowNs() - start) / steps);
+	}
+
+	DoNotOptimise(sink);
+}
+
+template<class T>
+static void RunElement(const char* element, int64_t max_bytes) {
+	// from L1 sized up to max_bytes, 16 times bigger each step. the int size type of the nstd queues
+	// keeps them under 2^30 elements
+	for (int64_t bytes = 16 << 10; bytes <= max_bytes; bytes *= 16) {
+		int64_t elements = bytes / (int64_t)sizeof(T);
+		if (elements > ((int64_t)1 << 30)) break;
+
+		// rounded down to a power of two so the vector ring and the value pool index with a mask
+		int64_t power = 1;
+		while (power * 2 <= elements) power *= 2;
+		elements = power;
+
+		fprintf(stderr, "%s %lld elements\n", element, (long long)elements);
+		Run<nstd::queue<T>, T>("nstd::queue", element, elements);
+		if constexpr (std::is_trivial<T>()) Run<nstd::queue_trivial<T>, T>("nstd::queue_trivial", element, elements);
+		Run<std::deque<T>, T>("std::deque", element, elements);
+		Run<std::queue<T>, T>("std::queue", element, elements);
+		Run<VectorRing<T>, T>("vector ring", element, elements);
+	}
+}
+
+int main(int argc, char** argv) {
+	int64_t max_bytes = (int64_t)(argc > 1 ? atoll(argv[1]) : 256) << 20;
+
+	printf("{\n  \"max_bytes\": %lld,\n  \"results\": [", (long long)max_bytes);
+	RunElement<int32_t>("4B", max_bytes);
+	RunElement<Bytes64>("64B", max_bytes);
+	RunElement<Bytes256>("256B", max_bytes);
+	RunElement<std::string>("string", max_bytes);
+	printf("\n  ]\n}\n");
+
+	return 0;
+}
@@ -0,0 +1,250 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <bit>
+#include "queue.hpp"
+
+// a queue of small values (flags, 2 or 4 bit states...) packed into 64 bit words, Bits bits each, instead of a byte
+// or more per value like queue_trivial<bool>.
+//
+// the words form a ring just like the buffer of queue_trivial, positions are counted in values. values never
+// straddle two words since Bits divides 64. push_back/pop are O(1) bit twiddling, push_bits/pop_bits move up to a
+// whole word of values at once, and count() goes word by word with popcount, so scans run at word speed.
+// the first value in a word is in its lowest bits.
+namespace nstd {
+
+    template <int Bits>
+    struct bit_queue {
+        static_assert(Bits == 1 || Bits == 2 || Bits == 4 || Bits == 8 || Bits == 16 || Bits == 32, "Bits has to divide 64");
+
+        static constexpr int per_word = 64 / Bits;
+        static constexpr uint64_t value_mask = Bits == 64 ? ~(uint64_t)0 : (((uint64_t)1 << Bits) - 1);
+
+    private:
+        uint64_t* buffer_ = nullptr;
+        int64_t words_ = 0;
+        int64_t front_ = 0; // in values, like everything else
+        int64_t back_ = 0;
+        int64_t capacity_ = 0;
+        int64_t size_ = 0;
+
+        // mask of the low count values of a word
+        static uint64_t low_values(int count) noexcept {
+            return count >= per_word ? ~(uint64_t)0 : (((uint64_t)1 << (count * Bits)) - 1);
+        }
+
+        // count values starting at position, packed into the low bits. count <= per_word, may span two words
+        uint64_t read_bits(int64_t position, int count) const noexcept {
+            int64_t word = position / per_word;
+            int offset = (int)(position % per_word);
+
+            uint64_t result = buffer_[word] >> (offset * Bits);
+            int taken = per_word - offset;
+            if (taken < count) {
+                int64_t next = word + 1 == words_ ? 0 : word + 1;
+                result |= buffer_[next] << (taken * Bits);
+            }
+            return result & low_values(count);
+        }
+
+        // the reverse of read_bits
+        void write_bits(int64_t position, uint64_t bits, int count) noexcept {
+            int64_t word = position / per_word;
+            int offset = (int)(position % per_word);
+            bits &= low_values(count);
+
+            int here = per_word - offset < count ? per_word - offset : count;
+            uint64_t mask = low_values(here) << (offset * Bits);
+            buffer_[word] = (buffer_[word] & ~mask) | ((bits << (offset * Bits)) & mask);
+
+            if (here < count) {
+                int64_t next = word + 1 == words_ ? 0 : word + 1;
+                uint64_t rest = bits >> (here * Bits);
+                uint64_t rest_mask = low_values(count - here);
+                buffer_[next] = (buffer_[next] & ~rest_mask) | rest;
+            }
+        }
+
+        int64_t wrap(int64_t position) const noexcept {
+            return position >= capacity_ ? position - capacity_ : position;
+        }
+
+        // unrolls into a new ring of new_words words, a word at a time
+        void reallocate(int64_t new_words) noexcept {
+            uint64_t* buffer_new = (uint64_t*)malloc(sizeof(uint64_t) * new_words);
+            if (buffer_new == nullptr) abort();
+            memset(buffer_new, 0, sizeof(uint64_t) * new_words);
+
+            int64_t position = front_;
+            for (int64_t done = 0, word = 0; done < size_; done += per_word, ++word) {
+                int count = size_ - done < per_word ? (int)(size_ - done) : per_word;
+                buffer_new[word] = read_bits(position, count);
+                position = wrap(position + count);
+            }
+
+            free(buffer_);
+            buffer_ = buffer_new;
+            words_ = new_words;
+            capacity_ = new_words * per_word;
+
+            front_ = 0;
+            back_ = size_ % capacity_;
+        }
+
+        void should_reallocate(int64_t count) noexcept {
+            if (size_ + count > capacity_) reserve(size_ + count);
+        }
+
+    public:
+
+        bit_queue() noexcept {}
+
+        bit_queue(const bit_queue& queue) = delete;
+        bit_queue& operator=(const bit_queue& queue) = delete;
+
+        ~bit_queue() {
+            free(buffer_);
+        }
+
+        // doubles the words until count values fit
+        void reserve(int64_t count) noexcept {
+            if (count <= capacity_) return;
+
+            int64_t new_words = words_ == 0 ? 1 : words_;
+            while (new_words * per_word < count) new_words *= 2;
+            reallocate(new_words);
+        }
+
+        void clear() noexcept {
+            front_ = 0;
+            back_ = 0;
+            size_ = 0;
+        }
+
+        void push_back(uint64_t value) noexcept {
+            assert(value <= value_mask);
+            should_reallocate(1);
+
+            int64_t word = back_ / per_word;
+            int shift = (int)(back_ % per_word) * Bits;
+            buffer_[word] = (buffer_[word] & ~(value_mask << shift)) | (value << shift);
+
+            back_ = wrap(back_ + 1);
+            ++size_;
+        }
+
+        // count values (up to per_word) packed in the low bits of bits, the first one lowest
+        void push_bits(uint64_t bits, int count) noexcept {
+            assert(count >= 0 && count <= per_word);
+            if (count == 0) return;
+            should_reallocate(count);
+
+            write_bits(back_, bits, count);
+            back_ = wrap(back_ + count);
+            size_ += count;
+        }
+
+        // a whole word of values
+        void push_word(uint64_t bits) noexcept {
+            push_bits(bits, per_word);
+        }
+
+        uint64_t front() const noexcept {
+            assert(size_ != 0);
+
+            return (buffer_[front_ / per_word] >> ((front_ % per_word) * Bits)) & value_mask;
+        }
+
+        void pop() noexcept {
+            assert(size_ != 0);
+
+            front_ = wrap(front_ + 1);
+            --size_;
+        }
+
+        // pops count values (up to per_word) and returns them packed like push_bits takes them
+        uint64_t pop_bits(int count) noexcept {
+            assert(count >= 0 && count <= per_word && count <= size_);
+            if (count == 0) return 0;
+
+            uint64_t bits = read_bits(front_, count);
+            front_ = wrap(front_ + count);
+            size_ -= count;
+            return bits;
+        }
+
+        uint64_t pop_word() noexcept {
+            return pop_bits(per_word);
+        }
+
+        uint64_t operator[](int64_t i) const noexcept {
+            assert(i >= 0 && i < size_);
+
+            int64_t position = wrap(front_ + i);
+            return (buffer_[position / per_word] >> ((position % per_word) * Bits)) & value_mask;
+        }
+
+        void set(int64_t i, uint64_t value) noexcept {
+            assert(i >= 0 && i < size_);
+            assert(value <= value_mask);
+
+            int64_t position = wrap(front_ + i);
+            int shift = (int)(position % per_word) * Bits;
+            uint64_t& word = buffer_[position / per_word];
+            word = (word & ~(value_mask << shift)) | (value << shift);
+        }
+
+        // how many values equal value, a word at a time with popcount
+        int64_t count(uint64_t value = 1) const noexcept {
+            assert(value <= value_mask);
+
+            // every field of the word set to value, and the lowest bit of every field
+            uint64_t pattern = 0;
+            uint64_t low_bits = 0;
+            for (int i = 0; i < per_word; ++i) {
+                pattern |= value << (i * Bits);
+                low_bits |= (uint64_t)1 << (i * Bits);
+            }
+
+            int64_t matches = 0;
+            int64_t position = front_;
+            int64_t remaining = size_;
+            while (remaining > 0) {
+                int offset = (int)(position % per_word);
+                int count = per_word - offset < remaining ? per_word - offset : (int)remaining;
+                uint64_t bits = (buffer_[position / per_word] >> (offset * Bits)) & low_values(count);
+
+                if (Bits == 1) {
+                    matches += value == 1 ? std::popcount(bits) : count - std::popcount(bits);
+                }
+                else {
+                    // fields that are zero after the xor matched. fold each field onto its lowest bit
+                    uint64_t differ = bits ^ (pattern & low_values(count));
+                    for (int shift = 1; shift < Bits; shift <<= 1) differ |= differ >> shift;
+                    matches += std::popcount(~differ & low_bits & low_values(count));
+                }
+
+                position = wrap(position + count);
+                remaining -= count;
+            }
+            return matches;
+        }
+
+        int64_t size() const noexcept {
+            return size_;
+        }
+
+        bool empty() const noexcept {
+            return size_ == 0;
+        }
+
+        int64_t capacity() const noexcept {
+            return capacity_;
+        }
+
+        int64_t memory_bytes() const noexcept {
+            return (int64_t)sizeof(uint64_t) * words_;
+        }
+    };
+}
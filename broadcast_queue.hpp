@@ -0,0 +1,229 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include "queue.hpp"
+
+// single writer, many readers, and every reader sees every message (disruptor style).
+// there is one power of two buffer. the producer publishes a sequence number and each reader keeps its own
+// cursor into the buffer, so a message is written once however many readers there are.
+// the producer can't lap the slowest reader: it only writes a slot once every reader has moved past it.
+//
+// sequences are free running counters, a slot is sequence & (capacity - 1).
+// plain old data only, readers get pointers straight into the buffer.
+namespace nstd {
+
+    template <class T>
+    struct broadcast_queue;
+
+    // a reader's handle. one thread per reader, the handle is not shared
+    template <class T>
+    struct broadcast_reader {
+    private:
+        friend struct broadcast_queue<T>;
+
+        broadcast_queue<T>* queue_ = nullptr;
+        int index_ = -1;
+        size_t published_cache_ = 0;
+
+        broadcast_reader(broadcast_queue<T>* queue, int index) noexcept : queue_(queue), index_(index) {}
+
+    public:
+        broadcast_reader() noexcept {}
+
+        bool valid() const noexcept {
+            return queue_ != nullptr;
+        }
+
+        // up to n published messages this reader hasn't seen yet
+        segments<const T, size_t> peek(size_t n) noexcept {
+            return queue_->reader_peek(*this, n);
+        }
+
+        // done with the first n peeked messages, the producer may reuse their slots
+        void release(size_t n) noexcept {
+            queue_->reader_release(*this, n);
+        }
+
+        bool try_read(T& data) noexcept {
+            segments<const T, size_t> readable = peek(1);
+            if (readable.size() == 0) return false;
+
+            data = readable[0];
+            release(1);
+            return true;
+        }
+    };
+
+    template <class T>
+    struct broadcast_queue {
+        static_assert(std::is_trivially_copyable<T>(), "type in this queue is not trivially copyable when it needs to be");
+
+    private:
+        friend struct broadcast_reader<T>;
+
+        // an unused cursor never holds the producer back, a joining one holds it where it already is
+        static constexpr size_t cursor_unused = ~(size_t)0;
+        static constexpr size_t cursor_joining = ~(size_t)0 - 1;
+
+        struct alignas(64) cursor {
+            std::atomic<size_t> next{ cursor_unused };
+        };
+
+        T* buffer_ = nullptr;
+        size_t capacity_ = 0;
+        size_t mask_ = 0;
+
+        cursor* cursors_ = nullptr;
+        int max_readers_ = 0;
+        std::mutex readers_mutex_;
+
+        // producer side. gate_cache_ is the slowest reader's cursor as last seen by the producer
+        alignas(64) std::atomic<size_t> published_{ 0 };
+        size_t gate_cache_ = 0;
+
+        // producer only. the fence pairs with the one in add_reader, see there
+        size_t slowest_reader(size_t published) const noexcept {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            size_t slowest = published;
+            for (int i = 0; i < max_readers_; ++i) {
+                size_t next = cursors_[i].next.load(std::memory_order_acquire);
+                if (next == cursor_joining) next = gate_cache_;
+                if (next < slowest) slowest = next;
+            }
+            return slowest;
+        }
+
+        segments<T, size_t> make_segments(size_t start, size_t count) const noexcept {
+            size_t index = start & mask_;
+            size_t first = capacity_ - index;
+            if (first > count) first = count;
+
+            segments<T, size_t> result;
+            result.first = { buffer_ + index, first };
+            result.second = { buffer_, count - first };
+            return result;
+        }
+
+        segments<const T, size_t> reader_peek(broadcast_reader<T>& reader, size_t n) noexcept {
+            size_t next = cursors_[reader.index_].next.load(std::memory_order_relaxed);
+            size_t available = reader.published_cache_ - next;
+            if (available < n) {
+                reader.published_cache_ = published_.load(std::memory_order_acquire);
+                available = reader.published_cache_ - next;
+            }
+            if (n > available) n = available;
+
+            segments<T, size_t> readable = make_segments(next, n);
+
+            segments<const T, size_t> result;
+            result.first = { readable.first.data, readable.first.size };
+            result.second = { readable.second.data, readable.second.size };
+            return result;
+        }
+
+        void reader_release(broadcast_reader<T>& reader, size_t n) noexcept {
+            std::atomic<size_t>& next = cursors_[reader.index_].next;
+            size_t current = next.load(std::memory_order_relaxed);
+            assert(current + n <= reader.published_cache_);
+            next.store(current + n, std::memory_order_release);
+        }
+
+    public:
+
+        // capacity is rounded up to a power of two
+        broadcast_queue(size_t capacity, int max_readers) {
+            capacity_ = 2;
+            while (capacity_ < capacity) capacity_ *= 2;
+            mask_ = capacity_ - 1;
+
+            buffer_ = (T*)malloc(sizeof(T) * capacity_);
+            if (buffer_ == nullptr) abort();
+
+            max_readers_ = max_readers;
+            cursors_ = new cursor[max_readers_];
+        }
+
+        broadcast_queue(const broadcast_queue& queue) = delete;
+        broadcast_queue& operator=(const broadcast_queue& queue) = delete;
+
+        ~broadcast_queue() {
+            delete[] cursors_;
+            free(buffer_);
+        }
+
+        // a new reader starts at the next message to be published, it doesn't see the history.
+        // returns an invalid reader if all max_readers are taken
+        broadcast_reader<T> add_reader() {
+            std::lock_guard<std::mutex> lock(readers_mutex_);
+
+            for (int i = 0; i < max_readers_; ++i) {
+                if (cursors_[i].next.load(std::memory_order_relaxed) != cursor_unused) continue;
+
+                // the producer may be scanning the cursors right now. joining holds its gate where it is, then
+                // after the fence either its next scan sees joining, or published_ below is at least as far as
+                // any scan that missed it let the producer write, so nothing from there on gets lapped
+                cursors_[i].next.store(cursor_joining, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                size_t published = published_.load(std::memory_order_acquire);
+                cursors_[i].next.store(published, std::memory_order_release);
+
+                broadcast_reader<T> reader(this, i);
+                reader.published_cache_ = published;
+                return reader;
+            }
+            return broadcast_reader<T>();
+        }
+
+        // the reader stops holding the producer back. removing a reader that isn't valid (add_reader failed, or it
+        // was already removed) does nothing
+        void remove_reader(broadcast_reader<T>& reader) {
+            assert(reader.valid());
+            if (!reader.valid()) return;
+
+            std::lock_guard<std::mutex> lock(readers_mutex_);
+
+            cursors_[reader.index_].next.store(cursor_unused, std::memory_order_release);
+            reader = broadcast_reader<T>();
+        }
+
+        // producer only. up to n slots every reader has finished with, fewer (maybe none) if
+        // the slowest reader is too far behind. nothing is visible to readers until commit
+        segments<T, size_t> claim(size_t n) noexcept {
+            size_t published = published_.load(std::memory_order_relaxed);
+            size_t free_slots = capacity_ - (published - gate_cache_);
+            if (free_slots < n) {
+                gate_cache_ = slowest_reader(published);
+                free_slots = capacity_ - (published - gate_cache_);
+            }
+            if (n > free_slots) n = free_slots;
+
+            return make_segments(published, n);
+        }
+
+        // producer only. publishes the first n claimed slots to every reader with one release store
+        void commit(size_t n) noexcept {
+            size_t published = published_.load(std::memory_order_relaxed);
+            assert(published + n - gate_cache_ <= capacity_);
+            published_.store(published + n, std::memory_order_release);
+        }
+
+        // producer only
+        bool try_push(const T& data) noexcept {
+            segments<T, size_t> writable = claim(1);
+            if (writable.size() == 0) return false;
+
+            writable[0] = data;
+            commit(1);
+            return true;
+        }
+
+        size_t published() const noexcept {
+            return published_.load(std::memory_order_acquire);
+        }
+
+        size_t capacity() const noexcept {
+            return capacity_;
+        }
+    };
+}
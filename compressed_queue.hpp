@@ -0,0 +1,269 @@
+#pragma once
+#include <stdint.h>
+#include <type_traits>
+#include "queue.hpp"
+
+// a queue of integers stored as delta encoded, bit packed blocks. made for long queues of timestamps and ids,
+// where neighbours are close together and 8 bytes per value is mostly zeros.
+//
+// values are grouped into blocks of block_size. a block keeps its first value as is and then the difference of
+// every value to the one before it (zigzag encoded so small negative steps stay small), packed with just enough
+// bits for the largest difference in that block.
+//
+// the back block is kept as plain values until it's full and the front block is unpacked when the consumer gets
+// to it, so push_back and pop are O(1). the packed blocks in between can be looked at one block at a time.
+// unpacking uses a kernel per bit width so every shift is a constant, which lets the compiler unroll and
+// vectorise it, and drain() hands the consumer a whole unpacked block at a time.
+namespace nstd {
+
+    template <class Int>
+    struct compressed_queue {
+        static_assert(std::is_integral<Int>(), "compressed_queue is for integers");
+
+        static constexpr int block_size = 128;
+
+    private:
+        using Unsigned = typename std::make_unsigned<Int>::type;
+        static constexpr int deltas = block_size - 1;
+        static constexpr int max_width = sizeof(Int) * 8;
+
+        struct block_info {
+            Int first;
+            int64_t word_offset; // where its packed words start, counted from the first word ever pushed
+            int width;
+        };
+
+        // packed blocks, oldest at the front
+        queue_trivial<block_info> blocks_;
+        queue_trivial<uint64_t> words_;
+        int64_t words_popped_ = 0;
+        int64_t words_pushed_ = 0;
+
+        // the back block, still plain values
+        Int tail_[block_size];
+        int tail_count_ = 0;
+
+        // the front block, already unpacked. values from head_pos_ to head_count_ are still in the queue
+        Int head_[block_size];
+        int head_pos_ = 0;
+        int head_count_ = 0;
+
+        static uint64_t zigzag(Unsigned delta) noexcept {
+            // arithmetic on the unsigned type wraps instead of overflowing. read it back as signed so a
+            // step backwards is a small negative number, then fold the sign into the bottom bit
+            int64_t value = (int64_t)(typename std::make_signed<Int>::type)delta;
+            return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+        }
+
+        static Unsigned unzigzag(uint64_t value) noexcept {
+            return (Unsigned)((value >> 1) ^ (uint64_t)(-(int64_t)(value & 1)));
+        }
+
+        static int width_of(uint64_t value) noexcept {
+            int width = 0;
+            while (value != 0) {
+                ++width;
+                value >>= 1;
+            }
+            return width;
+        }
+
+        static int64_t words_for(int width) noexcept {
+            return ((int64_t)deltas * width + 63) / 64;
+        }
+
+        template<int W>
+        static void unpack_width(const uint64_t* words, uint64_t* out) noexcept {
+            if (W == 0) {
+                for (int k = 0; k < deltas; ++k) out[k] = 0;
+                return;
+            }
+
+            const uint64_t mask = W == 64 ? ~(uint64_t)0 : (((uint64_t)1 << (W % 64)) - 1);
+            for (int k = 0; k < deltas; ++k) {
+                int bit = k * W;
+                int word = bit / 64;
+                int shift = bit % 64;
+
+                uint64_t value = words[word] >> shift;
+                if (shift + W > 64) value |= words[word + 1] << ((64 - shift) % 64);
+                out[k] = value & mask;
+            }
+        }
+
+        using unpack_function = void (*)(const uint64_t*, uint64_t*);
+
+        template<int... W>
+        static const unpack_function* make_unpack_table(std::integer_sequence<int, W...>) noexcept {
+            static const unpack_function table[] = { &unpack_width<W>... };
+            return table;
+        }
+
+        static const unpack_function* unpack_table() noexcept {
+            return make_unpack_table(std::make_integer_sequence<int, 65>());
+        }
+
+        // packs the full tail block and appends it to the packed blocks
+        void pack_tail() noexcept {
+            uint64_t zigzags[deltas];
+            uint64_t all = 0;
+            for (int k = 0; k < deltas; ++k) {
+                zigzags[k] = zigzag((Unsigned)((Unsigned)tail_[k + 1] - (Unsigned)tail_[k]));
+                all |= zigzags[k];
+            }
+            int width = width_of(all);
+
+            block_info info = { tail_[0], words_pushed_, width };
+            blocks_.push_back(info);
+
+            uint64_t packed[max_width * deltas / 64 + 2] = {};
+            for (int k = 0; k < deltas && width > 0; ++k) {
+                int bit = k * width;
+                int word = bit / 64;
+                int shift = bit % 64;
+
+                packed[word] |= zigzags[k] << shift;
+                if (shift + width > 64) packed[word + 1] |= zigzags[k] >> (64 - shift);
+            }
+
+            int64_t count = words_for(width);
+            words_.reserve(words_.size() + (int)count);
+            for (int64_t w = 0; w < count; ++w) words_.push_back(packed[w]);
+
+            words_pushed_ += count;
+            tail_count_ = 0;
+        }
+
+        void unpack(const block_info& info, Int* out) const noexcept {
+            int64_t count = words_for(info.width);
+
+            // the words of one block can wrap around the end of the ring, so copy them out first
+            uint64_t packed[max_width * deltas / 64 + 2];
+            int start = (int)(info.word_offset - words_popped_);
+            for (int64_t w = 0; w < count; ++w) packed[w] = words_[start + (int)w];
+
+            uint64_t zigzags[deltas];
+            unpack_table()[info.width](packed, zigzags);
+
+            Unsigned value = (Unsigned)info.first;
+            out[0] = (Int)value;
+            for (int k = 0; k < deltas; ++k) {
+                value += unzigzag(zigzags[k]);
+                out[k + 1] = (Int)value;
+            }
+        }
+
+        // makes sure head_ has the front value
+        void refill() noexcept {
+            if (head_pos_ < head_count_) return;
+
+            head_pos_ = 0;
+            if (!blocks_.empty()) {
+                block_info info = blocks_.front();
+                unpack(info, head_);
+                head_count_ = block_size;
+
+                blocks_.pop();
+                int64_t count = words_for(info.width);
+                words_.advance_front((int)count);
+                words_popped_ += count;
+            }
+            else {
+                memcpy(head_, tail_, sizeof(Int) * tail_count_);
+                head_count_ = tail_count_;
+                tail_count_ = 0;
+            }
+        }
+
+    public:
+
+        compressed_queue() noexcept {}
+
+        compressed_queue(const compressed_queue& queue) = delete;
+        compressed_queue& operator=(const compressed_queue& queue) = delete;
+
+        void push_back(Int value) noexcept {
+            tail_[tail_count_++] = value;
+            if (tail_count_ == block_size) pack_tail();
+        }
+
+        Int front() noexcept {
+            assert(size() != 0);
+
+            refill();
+            return head_[head_pos_];
+        }
+
+        void pop() noexcept {
+            assert(size() != 0);
+
+            refill();
+            ++head_pos_;
+        }
+
+        // calls func(const Int* values, int count) with runs of values from the front until the queue is empty.
+        // packed blocks are unpacked straight into one buffer, there is no per value bookkeeping
+        template<typename FuncValues>
+        void drain(FuncValues func) noexcept {
+            if (head_pos_ < head_count_) func(head_ + head_pos_, head_count_ - head_pos_);
+            head_pos_ = 0;
+            head_count_ = 0;
+
+            while (!blocks_.empty()) {
+                block_info info = blocks_.front();
+                unpack(info, head_);
+                func((const Int*)head_, block_size);
+
+                blocks_.pop();
+                int64_t count = words_for(info.width);
+                words_.advance_front((int)count);
+                words_popped_ += count;
+            }
+
+            if (tail_count_ > 0) func((const Int*)tail_, tail_count_);
+            tail_count_ = 0;
+        }
+
+        int64_t size() const noexcept {
+            return (int64_t)(head_count_ - head_pos_) + (int64_t)blocks_.size() * block_size + tail_count_;
+        }
+
+        bool empty() const noexcept {
+            return size() == 0;
+        }
+
+        // number of packed blocks between the front and the back
+        int block_count() const noexcept {
+            return blocks_.size();
+        }
+
+        // unpacks packed block i (0 is the oldest) into out, which needs room for block_size values
+        void read_block(int i, Int* out) const noexcept {
+            assert(i >= 0 && i < blocks_.size());
+
+            unpack(blocks_[i], out);
+        }
+
+        // random access. unpacks the block the value is in, so it's O(block_size)
+        Int operator[](int64_t i) const noexcept {
+            assert(i >= 0 && i < size());
+
+            int64_t in_head = head_count_ - head_pos_;
+            if (i < in_head) return head_[head_pos_ + i];
+            i -= in_head;
+
+            int64_t in_blocks = (int64_t)blocks_.size() * block_size;
+            if (i < in_blocks) {
+                Int values[block_size];
+                unpack(blocks_[(int)(i / block_size)], values);
+                return values[i % block_size];
+            }
+            return tail_[i - in_blocks];
+        }
+
+        // bytes used by the packed blocks and the two plain blocks
+        int64_t memory_bytes() const noexcept {
+            return (int64_t)sizeof(uint64_t) * words_.capacity() + (int64_t)sizeof(block_info) * blocks_.capacity() + sizeof(head_) + sizeof(tail_);
+        }
+    };
+}
@@ -0,0 +1,398 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include "queue.hpp"
+
+// unbounded multi producer multi consumer queue that grows while producers and consumers keep running.
+//
+// copying elements into a bigger buffer while other threads are using the old one isn't something that can be
+// done without stopping them, so instead of moving the contents the queue grows the way should_reallocate sizes things:
+// when the current ring is full it is closed and a ring of double the capacity is linked after it. producers move
+// on to the new ring straight away, consumers finish draining the old one first so FIFO order is kept.
+// a drained ring is retired to an epoch based reclamation domain and freed once no thread can still be looking at it.
+//
+// each ring is the bounded MPMC ring with a sequence number per cell (as described by Dmitry Vyukov).
+namespace nstd {
+
+    // epoch based reclamation. threads enter the domain (epoch_guard) before touching shared pointers and leave
+    // afterwards. retired pointers are freed once the global epoch has moved on twice since they were retired,
+    // by then every thread that could have seen them has left.
+    // there is one domain for the whole process, retiring is rare (once per ring) so it just takes a lock.
+    // a thread gets a slot the first time it enters and keeps it until it exits. there is no limit on the number
+    // of threads: the slots come in blocks, and a block is linked on when every slot is taken. blocks are only
+    // freed with the domain, so a scan never races with one going away.
+    struct epoch_domain {
+    private:
+        static constexpr int slots_per_block = 64;
+        static constexpr uint64_t idle = ~(uint64_t)0;
+
+        struct alignas(64) slot {
+            std::atomic<uint64_t> epoch{ idle };
+            std::atomic<bool> taken{ false };
+        };
+
+        struct slot_block {
+            slot slots[slots_per_block];
+            std::atomic<slot_block*> next{ nullptr };
+        };
+
+        struct retired {
+            void* pointer;
+            void (*deleter)(void*);
+            uint64_t epoch;
+        };
+
+        // one per thread, gives its slot back when the thread exits
+        struct thread_slot {
+            slot* owned = nullptr;
+            int depth = 0;
+
+            ~thread_slot() {
+                if (owned != nullptr) owned->taken.store(false, std::memory_order_release);
+            }
+        };
+
+        std::atomic<uint64_t> global_epoch_{ 0 };
+        slot_block first_block_;
+
+        std::mutex retired_mutex_;
+        queue_trivial<retired> retired_;
+
+        // the first free slot, linking on a new block when there isn't one
+        slot* take_slot() {
+            slot_block* block = &first_block_;
+            for (;;) {
+                for (slot& candidate : block->slots) {
+                    bool expected = false;
+                    if (candidate.taken.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) return &candidate;
+                }
+
+                slot_block* next = block->next.load(std::memory_order_acquire);
+                if (next == nullptr) {
+                    // take the first slot of the new block before anyone else can see it
+                    slot_block* added = new slot_block();
+                    added->slots[0].taken.store(true, std::memory_order_relaxed);
+                    if (block->next.compare_exchange_strong(next, added, std::memory_order_acq_rel)) return &added->slots[0];
+
+                    // another thread linked one first, carry on into that
+                    delete added;
+                }
+                block = next;
+            }
+        }
+
+        static thread_slot& this_thread_slot() {
+            thread_local thread_slot local;
+            if (local.owned == nullptr) local.owned = global().take_slot();
+            return local;
+        }
+
+        // the epoch moves on only when every thread inside has caught up with it
+        void try_advance() noexcept {
+            uint64_t epoch = global_epoch_.load(std::memory_order_seq_cst);
+            for (slot_block* block = &first_block_; block != nullptr; block = block->next.load(std::memory_order_acquire)) {
+                for (slot& thread : block->slots) {
+                    uint64_t local = thread.epoch.load(std::memory_order_seq_cst);
+                    if (local != idle && local != epoch) return;
+                }
+            }
+            global_epoch_.compare_exchange_strong(epoch, epoch + 1, std::memory_order_seq_cst);
+        }
+
+        // retired_ is in retire order so it's also in epoch order, free from the front
+        void free_safe() noexcept {
+            uint64_t epoch = global_epoch_.load(std::memory_order_seq_cst);
+            while (!retired_.empty() && retired_.front().epoch + 2 <= epoch) {
+                retired& item = retired_.front();
+                item.deleter(item.pointer);
+                retired_.pop();
+            }
+        }
+
+    public:
+
+        epoch_domain() {}
+
+        epoch_domain(const epoch_domain& domain) = delete;
+        epoch_domain& operator=(const epoch_domain& domain) = delete;
+
+        // the process is going away, nobody is inside anymore
+        ~epoch_domain() {
+            while (!retired_.empty()) {
+                retired& item = retired_.front();
+                item.deleter(item.pointer);
+                retired_.pop();
+            }
+
+            slot_block* block = first_block_.next.load(std::memory_order_acquire);
+            while (block != nullptr) {
+                slot_block* next = block->next.load(std::memory_order_relaxed);
+                delete block;
+                block = next;
+            }
+        }
+
+        static epoch_domain& global() {
+            static epoch_domain domain;
+            return domain;
+        }
+
+        void enter() noexcept {
+            thread_slot& local = this_thread_slot();
+            if (local.depth++ > 0) return;
+
+            // publish the epoch we saw and check it didn't move underneath us,
+            // otherwise something retired in between could be freed while we use it
+            std::atomic<uint64_t>& mine = local.owned->epoch;
+            uint64_t epoch = global_epoch_.load(std::memory_order_seq_cst);
+            for (;;) {
+                mine.store(epoch, std::memory_order_seq_cst);
+                uint64_t now = global_epoch_.load(std::memory_order_seq_cst);
+                if (now == epoch) break;
+                epoch = now;
+            }
+        }
+
+        void leave() noexcept {
+            thread_slot& local = this_thread_slot();
+            if (--local.depth > 0) return;
+
+            local.owned->epoch.store(idle, std::memory_order_release);
+        }
+
+        // pointer must already be unreachable for threads that enter from now on
+        void retire(void* pointer, void (*deleter)(void*)) {
+            std::lock_guard<std::mutex> lock(retired_mutex_);
+
+            retired_.push_back({ pointer, deleter, global_epoch_.load(std::memory_order_seq_cst) });
+            try_advance();
+            free_safe();
+        }
+
+        // frees whatever has become safe without retiring anything new
+        void collect() {
+            std::lock_guard<std::mutex> lock(retired_mutex_);
+
+            try_advance();
+            free_safe();
+        }
+    };
+
+    struct epoch_guard {
+        epoch_guard() noexcept { epoch_domain::global().enter(); }
+        ~epoch_guard() { epoch_domain::global().leave(); }
+
+        epoch_guard(const epoch_guard& guard) = delete;
+        epoch_guard& operator=(const epoch_guard& guard) = delete;
+    };
+
+    template <class T>
+    struct concurrent_queue {
+    private:
+        // set in a ring's enqueue position once it's full, no producer gets in after that
+        static constexpr size_t closed_bit = (size_t)1 << (sizeof(size_t) * 8 - 1);
+
+        enum class enqueue_result { ok, full, closed };
+
+        struct cell {
+            std::atomic<size_t> sequence;
+            alignas(T) unsigned char storage[sizeof(T)];
+
+            T* data() noexcept { return reinterpret_cast<T*>(storage); }
+        };
+
+        struct ring {
+            cell* cells = nullptr;
+            size_t capacity = 0;
+            size_t mask = 0;
+
+            alignas(64) std::atomic<size_t> enqueue_pos{ 0 };
+            alignas(64) std::atomic<size_t> dequeue_pos{ 0 };
+            alignas(64) std::atomic<ring*> next{ nullptr };
+
+            explicit ring(size_t ring_capacity) {
+                capacity = ring_capacity;
+                mask = capacity - 1;
+
+                cells = (cell*)malloc(sizeof(cell) * capacity);
+                if (cells == nullptr) abort();
+
+                for (size_t i = 0; i < capacity; ++i) {
+                    new (&cells[i].sequence) std::atomic<size_t>(i);
+                }
+            }
+
+            ~ring() {
+                free(cells);
+            }
+
+            // only moves out of data on success
+            enqueue_result try_enqueue(T& data) noexcept {
+                size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+                cell* target;
+                for (;;) {
+                    if (pos & closed_bit) return enqueue_result::closed;
+
+                    target = &cells[pos & mask];
+                    size_t sequence = target->sequence.load(std::memory_order_acquire);
+                    intptr_t dif = (intptr_t)sequence - (intptr_t)pos;
+
+                    if (dif == 0) {
+                        if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                    }
+                    else if (dif < 0) {
+                        return enqueue_result::full;
+                    }
+                    else {
+                        pos = enqueue_pos.load(std::memory_order_relaxed);
+                    }
+                }
+
+                new (target->data()) T(std::move(data));
+                target->sequence.store(pos + 1, std::memory_order_release);
+                return enqueue_result::ok;
+            }
+
+            bool try_dequeue(T& data) noexcept {
+                size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+                cell* target;
+                for (;;) {
+                    target = &cells[pos & mask];
+                    size_t sequence = target->sequence.load(std::memory_order_acquire);
+                    intptr_t dif = (intptr_t)sequence - (intptr_t)(pos + 1);
+
+                    if (dif == 0) {
+                        if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+                    }
+                    else if (dif < 0) {
+                        return false;
+                    }
+                    else {
+                        pos = dequeue_pos.load(std::memory_order_relaxed);
+                    }
+                }
+
+                T* value = target->data();
+                data = std::move(*value);
+                value->~T();
+                target->sequence.store(pos + mask + 1, std::memory_order_release);
+                return true;
+            }
+
+            void close() noexcept {
+                enqueue_pos.fetch_or(closed_bit, std::memory_order_acq_rel);
+            }
+
+            // closed and every position handed out to a producer has been taken by a consumer
+            bool drained() const noexcept {
+                size_t enqueued = enqueue_pos.load(std::memory_order_acquire);
+                if (!(enqueued & closed_bit)) return false;
+                return dequeue_pos.load(std::memory_order_acquire) >= (enqueued & ~closed_bit);
+            }
+        };
+
+        static void delete_ring(void* pointer) {
+            delete (ring*)pointer;
+        }
+
+        alignas(64) std::atomic<ring*> head_{ nullptr };
+        alignas(64) std::atomic<ring*> tail_{ nullptr };
+        size_t max_ring_capacity_ = 0;
+
+        // whoever finds the tail closed links the next ring, the loser of the race frees theirs
+        ring* next_ring(ring* full) {
+            ring* next = full->next.load(std::memory_order_acquire);
+            if (next != nullptr) return next;
+
+            size_t capacity = full->capacity * 2;
+            if (capacity > max_ring_capacity_) capacity = max_ring_capacity_;
+
+            ring* created = new ring(capacity);
+            if (full->next.compare_exchange_strong(next, created, std::memory_order_acq_rel)) return created;
+
+            delete created;
+            return next;
+        }
+
+    public:
+
+        // capacities are rounded up to a power of two. rings double in size until max_ring_capacity,
+        // after that every new ring is max_ring_capacity (which makes it a linked list of fixed size rings)
+        explicit concurrent_queue(size_t initial_capacity = 64, size_t max_ring_capacity = (size_t)1 << 30) {
+            size_t capacity = 2;
+            while (capacity < initial_capacity) capacity *= 2;
+
+            max_ring_capacity_ = 2;
+            while (max_ring_capacity_ < max_ring_capacity) max_ring_capacity_ *= 2;
+            if (max_ring_capacity_ < capacity) max_ring_capacity_ = capacity;
+
+            ring* first = new ring(capacity);
+            head_.store(first, std::memory_order_relaxed);
+            tail_.store(first, std::memory_order_relaxed);
+        }
+
+        concurrent_queue(const concurrent_queue& queue) = delete;
+        concurrent_queue& operator=(const concurrent_queue& queue) = delete;
+
+        // no other thread may be using the queue anymore
+        ~concurrent_queue() {
+            ring* current = head_.load(std::memory_order_relaxed);
+            while (current != nullptr) {
+                ring* next = current->next.load(std::memory_order_relaxed);
+
+                // call the destructors of whatever is still in there
+                size_t end = current->enqueue_pos.load(std::memory_order_relaxed) & ~closed_bit;
+                for (size_t pos = current->dequeue_pos.load(std::memory_order_relaxed); pos < end; ++pos) {
+                    current->cells[pos & current->mask].data()->~T();
+                }
+
+                delete current;
+                current = next;
+            }
+            epoch_domain::global().collect();
+        }
+
+        void push_back(T data) {
+            epoch_guard guard;
+
+            for (;;) {
+                ring* tail = tail_.load(std::memory_order_acquire);
+
+                enqueue_result result = tail->try_enqueue(data);
+                if (result == enqueue_result::ok) return;
+                if (result == enqueue_result::full) tail->close();
+
+                ring* next = next_ring(tail);
+                tail_.compare_exchange_strong(tail, next, std::memory_order_acq_rel);
+            }
+        }
+
+        // false when the queue was seen empty
+        bool try_pop(T& data) {
+            epoch_guard guard;
+
+            for (;;) {
+                ring* head = head_.load(std::memory_order_acquire);
+                if (head->try_dequeue(data)) return true;
+
+                ring* next = head->next.load(std::memory_order_acquire);
+                if (next == nullptr) return false;
+
+                // a producer still finishing its write into the old ring, wait for it to keep FIFO
+                if (!head->drained()) {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                // nothing may point at the old ring before it's retired, so move the tail past it too
+                ring* expected = head;
+                tail_.compare_exchange_strong(expected, next, std::memory_order_acq_rel);
+                if (head_.compare_exchange_strong(head, next, std::memory_order_acq_rel)) {
+                    epoch_domain::global().retire(head, delete_ring);
+                }
+            }
+        }
+    };
+}
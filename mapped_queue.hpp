@@ -0,0 +1,309 @@
+#pragma once
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <limits>
+#include "queue.hpp"
+
+// a queue_trivial whose ring lives in a memory mapped file, so it survives restarts (posix only).
+// the file starts with two header slots (front, back, size, capacity, a sequence number and a checksum of those)
+// followed by the ring. every change writes the slot the previous change didn't, with the next sequence number,
+// so a header torn by a crash part way through leaves the other slot intact. opening an existing file takes the
+// newest slot that checks out and carries on where it left off, nothing is replayed.
+//
+// growing doubles the capacity like should_reallocate: the file is extended with posix_fallocate and mapped again.
+// if the ring had wrapped, the wrapped part is copied to just after the old end before the header is updated,
+// so a crash part way through still leaves the old header describing valid data. if the file can't grow,
+// push_back returns the error and the queue is left as it was.
+// writes reach the file whenever the kernel writes the pages back, call sync() to force it.
+namespace nstd {
+
+    struct mapped_header {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t element_size;
+        uint64_t sequence; // the slot with the highest one is the current header
+        int64_t capacity;
+        int64_t front;
+        int64_t back;
+        int64_t size;
+        uint64_t checksum; // of everything above
+    };
+
+    // fnv-1a, it only has to notice a torn or foreign header
+    inline uint64_t mapped_checksum(const mapped_header& header) noexcept {
+        const unsigned char* bytes = (const unsigned char*)&header;
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < offsetof(mapped_header, checksum); ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    template <class T, typename INT_TYPE = int>
+    struct mapped_queue {
+        static_assert(std::is_fundamental<INT_TYPE>(), "INT_TYPE is not an integer");
+        static_assert(std::is_trivially_copyable<T>(), "type in this queue is not trivially copyable when it needs to be");
+
+    private:
+        static constexpr uint64_t magic = 0x657565757170616dull; // "mapqueue"
+        static constexpr uint32_t version = 2;
+        // the slots sit in different disk sectors so writing one back can't tear the other
+        static constexpr size_t header_slot_size = 2048;
+        // the ring starts a page in so it's page aligned
+        static constexpr size_t data_offset = 4096;
+        static_assert(sizeof(mapped_header) <= header_slot_size && 2 * header_slot_size <= data_offset);
+
+        int fd_ = -1;
+        char* map_ = nullptr;
+        size_t map_size_ = 0;
+
+        T* buffer_ = nullptr;
+        uint64_t sequence_ = 0;
+        INT_TYPE front_ = 0;
+        INT_TYPE back_ = 0;
+        INT_TYPE capacity_ = 0;
+        INT_TYPE size_ = 0;
+
+        static size_t file_size(INT_TYPE capacity) noexcept {
+            return data_offset + sizeof(T) * (size_t)capacity;
+        }
+
+        static size_t slot_offset(uint64_t sequence) noexcept {
+            return (sequence & 1) * header_slot_size;
+        }
+
+        // the new mapping is made before the old one goes, so a failure leaves the queue mapped as it was
+        int map(size_t size) noexcept {
+            void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+            if (map == MAP_FAILED) return -errno;
+
+            unmap();
+            map_ = (char*)map;
+            map_size_ = size;
+            buffer_ = (T*)(map_ + data_offset);
+            return 0;
+        }
+
+        void unmap() noexcept {
+            if (map_ != nullptr) munmap(map_, map_size_);
+            map_ = nullptr;
+            map_size_ = 0;
+            buffer_ = nullptr;
+        }
+
+        // the indices are used without bounds checks, so a slot that passes the checksum but points outside the
+        // ring is rejected too
+        bool valid_header(const mapped_header& header) const noexcept {
+            bool valid = header.magic == magic && header.version == version && header.element_size == sizeof(T)
+                && header.checksum == mapped_checksum(header)
+                && header.capacity >= 0 && (uint64_t)header.capacity <= (uint64_t)std::numeric_limits<INT_TYPE>::max()
+                && (uint64_t)header.capacity <= (map_size_ - data_offset) / sizeof(T)
+                && header.size >= 0 && header.size <= header.capacity;
+            if (valid && header.capacity == 0) {
+                return header.front == 0 && header.back == 0;
+            }
+            return valid && header.front >= 0 && header.front < header.capacity
+                && header.back == (header.front + header.size) % header.capacity;
+        }
+
+        // fills the slot the last write didn't use, the current header stays intact until this one is complete
+        void write_header() noexcept {
+            ++sequence_;
+            mapped_header* header = (mapped_header*)(map_ + slot_offset(sequence_));
+            header->magic = magic;
+            header->version = version;
+            header->element_size = sizeof(T);
+            header->sequence = sequence_;
+            header->capacity = capacity_;
+            header->front = front_;
+            header->back = back_;
+            header->size = size_;
+            header->checksum = mapped_checksum(*header);
+        }
+
+        // returns 0, or a negative errno if the file couldn't grow or be mapped again
+        int should_reallocate() noexcept {
+
+            if (capacity_ == size_) {
+
+                if (capacity_ > std::numeric_limits<INT_TYPE>::max() / 2) return -EOVERFLOW;
+                INT_TYPE capacity_new = capacity_ == 0 ? 2 : capacity_ * 2;
+
+                // allocated rather than just extended, running out of space is an error here instead of a SIGBUS
+                // on some later write to the mapping
+                int error = posix_fallocate(fd_, 0, (off_t)file_size(capacity_new));
+                if (error != 0) return -error;
+
+                error = map(file_size(capacity_new));
+                if (error != 0) return error;
+
+                // the ring is full so back_ == front_. unwrap by copying [0, back_) to just after the old end
+                if (size_ > 0 && front_ != 0) {
+                    memcpy(buffer_ + capacity_, buffer_, sizeof(T) * back_);
+                }
+                back_ = (front_ + size_) % capacity_new;
+                capacity_ = capacity_new;
+
+                write_header();
+            }
+            return 0;
+        }
+
+    public:
+
+        mapped_queue() noexcept {}
+
+        mapped_queue(const mapped_queue& queue) = delete;
+        mapped_queue& operator=(const mapped_queue& queue) = delete;
+
+        ~mapped_queue() {
+            close();
+        }
+
+        // opens or creates the file and resumes from the newest valid header slot.
+        // returns 0, or a negative errno (-EBADMSG if neither slot checks out or they were written for a different T)
+        int open(const char* path) noexcept {
+            assert(fd_ < 0);
+
+            fd_ = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            if (fd_ < 0) return -errno;
+
+            struct stat info;
+            if (fstat(fd_, &info) != 0) {
+                int error = -errno;
+                close();
+                return error;
+            }
+
+            // new file, write an empty header. the other slot stays zeroed, which never checks out
+            if (info.st_size == 0) {
+                int error = posix_fallocate(fd_, 0, (off_t)file_size(0));
+                if (error != 0) {
+                    close();
+                    return -error;
+                }
+
+                error = map(file_size(0));
+                if (error != 0) {
+                    close();
+                    return error;
+                }
+
+                write_header();
+                return 0;
+            }
+
+            if ((size_t)info.st_size < data_offset) {
+                close();
+                return -EBADMSG;
+            }
+
+            int error = map((size_t)info.st_size);
+            if (error != 0) {
+                close();
+                return error;
+            }
+
+            const mapped_header* newest = nullptr;
+            for (size_t slot = 0; slot < 2; ++slot) {
+                const mapped_header* header = (const mapped_header*)(map_ + slot * header_slot_size);
+                if (!valid_header(*header) || slot_offset(header->sequence) != slot * header_slot_size) continue;
+                if (newest == nullptr || header->sequence > newest->sequence) newest = header;
+            }
+            if (newest == nullptr) {
+                close();
+                return -EBADMSG;
+            }
+
+            sequence_ = newest->sequence;
+            capacity_ = (INT_TYPE)newest->capacity;
+            front_ = (INT_TYPE)newest->front;
+            back_ = (INT_TYPE)newest->back;
+            size_ = (INT_TYPE)newest->size;
+            return 0;
+        }
+
+        void close() noexcept {
+            unmap();
+            if (fd_ >= 0) ::close(fd_);
+            fd_ = -1;
+            sequence_ = 0;
+            front_ = 0;
+            back_ = 0;
+            capacity_ = 0;
+            size_ = 0;
+        }
+
+        // flushes the ring and the header to the file
+        int sync() noexcept {
+            if (msync(map_, map_size_, MS_SYNC) != 0) return -errno;
+            return 0;
+        }
+
+        // returns 0, or a negative errno if the file had to grow and couldn't. the queue is unchanged then
+        int push_back(const T& data) noexcept {
+            int error = should_reallocate();
+            if (error != 0) return error;
+
+            buffer_[back_] = data;
+            back_ = (back_ + 1) % capacity_;
+            ++size_;
+            write_header();
+            return 0;
+        }
+
+        T& front() noexcept {
+            assert(size_ != 0);
+
+            return buffer_[front_];
+        }
+
+        void pop() noexcept {
+            assert(size_ != 0);
+
+            front_ = (front_ + 1) % capacity_;
+            --size_;
+            write_header();
+        }
+
+        void clear() noexcept {
+            front_ = 0;
+            back_ = 0;
+            size_ = 0;
+            write_header();
+        }
+
+        INT_TYPE size() const noexcept {
+            return size_;
+        }
+
+        bool empty() const noexcept {
+            return size_ == 0;
+        }
+
+        INT_TYPE capacity() const noexcept {
+            return capacity_;
+        }
+
+        T& operator[](INT_TYPE i) noexcept {
+            assert(i >= 0 && i < size_);
+
+            INT_TYPE index_rolling = (front_ + i) % capacity_;
+            return buffer_[index_rolling];
+        }
+
+        const T& operator[](INT_TYPE i) const noexcept {
+            assert(i >= 0 && i < size_);
+
+            INT_TYPE index_rolling = (front_ + i) % capacity_;
+            return buffer_[index_rolling];
+        }
+    };
+}
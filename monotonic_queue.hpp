@@ -0,0 +1,105 @@
+#pragma once
+#include <stdint.h>
+#include <functional>
+#include "queue.hpp"
+
+// sliding window min/max in O(1): a queue_trivial of (key, value) entries where the values only ever get worse from
+// front to back. extreme() is the front, there's no rescanning the window.
+//
+// push_back evicts entries from the back that the new value beats (they can never be the extreme again, the new one
+// is at least as good and expires later), pop_expired drops entries from the front whose key has fallen out of the
+// window. keys are whatever the window is measured in, timestamps or sequence numbers, and have to be pushed in order.
+//
+// nstd::monotonic_queue<double> lows;                    // min, Compare = std::greater<double> for max
+// lows.push_back(now, price);
+// lows.pop_expired(now - window);
+// double low = lows.extreme();
+namespace nstd {
+
+    template <class T, class Compare = std::less<T>, class Key = int64_t>
+    struct monotonic_queue {
+        struct entry {
+            Key key;
+            T value;
+        };
+
+    private:
+        queue_trivial<entry> entries_;
+        queue_trivial<int> survivors_; // scratch for batch pushes
+        [[no_unique_address]] Compare compare_;
+
+    public:
+
+        monotonic_queue() noexcept {}
+
+        monotonic_queue(const monotonic_queue& queue) = delete;
+        monotonic_queue& operator=(const monotonic_queue& queue) = delete;
+
+        void push_back(const Key& key, const T& value) noexcept {
+            while (!entries_.empty() && !compare_(entries_.back().value, value)) {
+                entries_.pop_back();
+            }
+            entries_.push_back(entry{ key, value });
+        }
+
+        // the same as pushing them one by one. the batch is thinned out from its end first, so only values that
+        // beat everything after them touch the ring and the back of the queue is only compared against once
+        void push_back(const Key* keys, const T* values, int count) noexcept {
+            if (count <= 0) return;
+
+            survivors_.clear();
+            survivors_.reserve(count);
+            survivors_.push_back(count - 1);
+            for (int i = count - 2; i >= 0; --i) {
+                if (compare_(values[i], values[survivors_.back()])) survivors_.push_back(i);
+            }
+
+            // the last survivor found is the best of the batch
+            const T& best = values[survivors_.back()];
+            while (!entries_.empty() && !compare_(entries_.back().value, best)) {
+                entries_.pop_back();
+            }
+
+            entries_.reserve(entries_.size() + survivors_.size());
+            while (!survivors_.empty()) {
+                int i = survivors_.back();
+                survivors_.pop_back();
+                entries_.push_back(entry{ keys[i], values[i] });
+            }
+        }
+
+        // drops everything pushed with a key before oldest, the start of the window
+        void pop_expired(const Key& oldest) noexcept {
+            while (!entries_.empty() && entries_.front().key < oldest) {
+                entries_.pop();
+            }
+        }
+
+        // the min (or max) of everything in the window. the queue can't be empty
+        const T& extreme() noexcept {
+            assert(!entries_.empty());
+
+            return entries_.front().value;
+        }
+
+        // the key the extreme was pushed with
+        const Key& extreme_key() noexcept {
+            assert(!entries_.empty());
+
+            return entries_.front().key;
+        }
+
+        // entries kept, at most the number of values in the window
+        int size() const noexcept {
+            return entries_.size();
+        }
+
+        bool empty() const noexcept {
+            return entries_.empty();
+        }
+
+        void clear() noexcept {
+            entries_.clear();
+        }
+    };
+}
@@ -1,9 +1,128 @@
 #pragma once
 #include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <iterator> 
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// a prefetch hint for the cache line at address, rw is 0 for reading and 1 for writing. nothing where there's no hint
+#if defined(__GNUC__) || defined(__clang__)
+#define NSTD_QUEUE_PREFETCH(address, rw) __builtin_prefetch((address), (rw))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#define NSTD_QUEUE_PREFETCH(address, rw) _mm_prefetch((const char*)(address), _MM_HINT_T0)
+#elif defined(_MSC_VER) && defined(_M_ARM64)
+#include <intrin.h>
+#define NSTD_QUEUE_PREFETCH(address, rw) __prefetch((const void*)(address))
+#else
+#define NSTD_QUEUE_PREFETCH(address, rw) ((void)(address), (void)(rw))
+#endif
 
 namespace nstd {
 
+// a pointer and a count. used when a ring hands out its memory directly instead of one element at a time
+template <class T, typename INT_TYPE = int>
+struct span {
+    T* data = nullptr;
+    INT_TYPE size = 0;
+
+    T* begin() const noexcept { return data; }
+    T* end() const noexcept { return data + size; }
+
+    T& operator[](INT_TYPE i) const noexcept {
+        assert(i >= 0 && i < size);
+        return data[i];
+    }
+
+    // span<char> goes wherever span<const char> is taken. a conversion instead of a constructor so span stays an aggregate
+    template <class U, class = std::enable_if_t<std::is_same_v<U, const T>>>
+    operator span<U, INT_TYPE>() const noexcept {
+        return { data, size };
+    }
+};
+
+// a range of a ring is at most two contiguous pieces: up to the end of the buffer and then from the start of it
+template <class T, typename INT_TYPE = int>
+struct segments {
+    span<T, INT_TYPE> first;
+    span<T, INT_TYPE> second;
+
+    INT_TYPE size() const noexcept { return first.size + second.size; }
+
+    T& operator[](INT_TYPE i) const noexcept {
+        assert(i >= 0 && i < size());
+        return i < first.size ? first.data[i] : second.data[i - first.size];
+    }
+};
+
+// calls func(T&) on every element of pieces in order while prefetching the element distance ahead of it,
+// carrying on into the second piece when the first runs out. small elements are prefetched once per cache line
+template <class T, typename INT_TYPE, typename FuncElement>
+void prefetch_walk(const segments<T, INT_TYPE>& pieces, INT_TYPE distance, FuncElement func) {
+    constexpr INT_TYPE step = sizeof(T) >= 64 ? 1 : (INT_TYPE)(64 / sizeof(T));
+
+    const span<T, INT_TYPE> parts[2] = { pieces.first, pieces.second };
+    for (int p = 0; p < 2; ++p) {
+        T* data = parts[p].data;
+        INT_TYPE count = parts[p].size;
+
+        for (INT_TYPE i = 0; i < count; ++i) {
+            if (distance > 0 && i % step == 0) {
+                INT_TYPE ahead = i + distance;
+                if (ahead < count) NSTD_QUEUE_PREFETCH(data + ahead, 0);
+                else if (p == 0 && ahead - count < parts[1].size) NSTD_QUEUE_PREFETCH(parts[1].data + (ahead - count), 0);
+            }
+            func(data[i]);
+        }
+    }
+}
+
+// what the queues tell their Policy. every hook gets the queue's address so one policy type can tell queues apart.
+// pushed and popped elements are count slots starting at slot (wrapping around at capacity), and size is after the change.
+// on_reallocate is called before the elements move, front is where they start in the old buffer.
+// the default does nothing and takes no space, so a queue without a policy is exactly what it was
+struct queue_policy_none {
+    template<typename INT_TYPE> void on_push(const void*, INT_TYPE, INT_TYPE, INT_TYPE, INT_TYPE) noexcept {}
+    template<typename INT_TYPE> void on_pop(const void*, INT_TYPE, INT_TYPE, INT_TYPE, INT_TYPE) noexcept {}
+    template<typename INT_TYPE> void on_reallocate(const void*, INT_TYPE, INT_TYPE, INT_TYPE, INT_TYPE, size_t) noexcept {}
+    template<typename INT_TYPE> void on_clear(const void*, INT_TYPE) noexcept {}
+};
+
+// counts what a queue did, to pick reserve sizes and spot queues that grow all the time.
+// nstd::queue<T, int, nstd::queue_stats> q; ... q.stats().growths
+struct queue_stats {
+    int64_t pushes = 0;
+    int64_t pops = 0;
+    int64_t growths = 0;     // reallocations, from pushing or reserve
+    int64_t bytes_moved = 0; // by those reallocations
+    int64_t peak_size = 0;
+    int64_t peak_capacity = 0;
+
+    template<typename INT_TYPE>
+    void on_push(const void*, INT_TYPE, INT_TYPE count, INT_TYPE size, INT_TYPE) noexcept {
+        pushes += count;
+        if (size > peak_size) peak_size = size;
+    }
+
+    template<typename INT_TYPE>
+    void on_pop(const void*, INT_TYPE, INT_TYPE count, INT_TYPE, INT_TYPE) noexcept {
+        pops += count;
+    }
+
+    template<typename INT_TYPE>
+    void on_reallocate(const void*, INT_TYPE, INT_TYPE, INT_TYPE, INT_TYPE new_capacity, size_t bytes) noexcept {
+        ++growths;
+        bytes_moved += (int64_t)bytes;
+        if (new_capacity > peak_capacity) peak_capacity = new_capacity;
+    }
+
+    template<typename INT_TYPE> void on_clear(const void*, INT_TYPE) noexcept {}
+};
+
 // a circular queue that stores data contiguously.
 // stores a back and front handle. data is added to the back handle which is incremented.
 // if the size of the queue reaches the capacity, the queue is reallocated to double the size and the contents moved
@@ -15,7 +134,8 @@ namespace nstd {
 // by default, a signed int type is used to handle the size, capacity and the handles. I prefer this but some people don't so you can just change it
 // since it's a templated parameter
 // no copy constructors by design, you will write better code that way.
-template <class T, typename INT_TYPE = int>
+// Policy gets told about pushes, pops and reallocations, see queue_policy_none
+template <class T, typename INT_TYPE = int, class Policy = queue_policy_none>
 struct queue {
     static_assert(std::is_fundamental<INT_TYPE>(), "INT_TYPE is not an integer");
 private:
@@ -24,6 +144,7 @@ private:
     INT_TYPE back_ = 0; // back is not inclusive, it is one element after the last element
     INT_TYPE capacity_ = 0;
     INT_TYPE size_ = 0;
+    [[no_unique_address]] Policy policy_;
 
     struct iterator {
         using iterator_category = std::forward_iterator_tag;
@@ -53,9 +174,9 @@ public:
     queue() {}
 
     // deliberate. you don't need to copy these. write helper functions if you need to do that
-    queue(const queue<T>& queue) = delete;
-    queue<T>& operator=(const queue<T>& queue) = delete;
-    queue<T>& operator=(queue<T>&& type) = delete;
+    queue(const queue& queue) = delete;
+    queue& operator=(const queue& queue) = delete;
+    queue& operator=(queue&& type) = delete;
 
     ~queue() {
         if (buffer_ == nullptr) return;
@@ -71,34 +192,74 @@ public:
 
 private:
 
-    void should_reallocate() {
+    void reallocate(INT_TYPE new_capacity) {
+        assert(new_capacity > size_);
 
-        if (capacity_ == size_) {
+        T* buffer_new = (T*)malloc(sizeof(T) * new_capacity);
+        if (buffer_new == nullptr) abort();
 
-            if (capacity_ == 0) capacity_ = 2;
-            else capacity_ *= 2;
+        policy_.on_reallocate((const void*)this, front_, size_, capacity_, new_capacity, sizeof(T) * (size_t)size_);
 
-            T* buffer_new = (T*)malloc(sizeof(T) * capacity_);
-            if (buffer_new == nullptr) abort();
+        // move old buffer into new buffer 
+        // where we copy into the new buffer from it's
+        // start point. the new buffer is raw memory so construct in place
+        for (INT_TYPE i = 0; i < size_; i++) {
+            INT_TYPE index_rolling = (front_ + i) % capacity_;
+            new (&buffer_new[i]) T(std::move(buffer_[index_rolling]));
+            buffer_[index_rolling].~T();
+        }
 
-            // copy old buffer into new buffer 
-            // where we copy into the new buffer from it's
-            // start point 
-            for (INT_TYPE i = 0; i < size_; i++) {
-                INT_TYPE index_rolling = (front_ + i) % size_;
-                buffer_new[i] = std::move(buffer_[index_rolling]); // ensures we copy correctly (i think since move semantics are annoying and stupid)
-            }
+        // free the old buffer 
+        free(buffer_);
+        buffer_ = buffer_new;
+        capacity_ = new_capacity;
 
-            // free the old buffer 
-            free(buffer_);
-            buffer_ = buffer_new;
+        front_ = 0;
+        back_ = size_;
+    }
 
-            front_ = 0;
-            back_ = size_;
+    void should_reallocate() {
+
+        if (capacity_ == size_) {
+            reallocate(capacity_ == 0 ? 2 : capacity_ * 2);
         }
     }
 public:
 
+    // grows the same way pushing would (doubling) until there is room for count elements
+    void reserve(INT_TYPE count) {
+        if (count <= capacity_) return;
+
+        INT_TYPE new_capacity = capacity_ == 0 ? 2 : capacity_;
+        while (new_capacity < count) new_capacity *= 2;
+        reallocate(new_capacity);
+    }
+
+    INT_TYPE capacity() const noexcept {
+        return capacity_;
+    }
+
+    Policy& policy() noexcept {
+        return policy_;
+    }
+
+    const Policy& stats() const noexcept {
+        return policy_;
+    }
+
+    // the elements as contiguous pieces: from front_ towards the end of the buffer, then the part that wrapped around
+    nstd::segments<T, INT_TYPE> segments() const noexcept {
+        nstd::segments<T, INT_TYPE> used;
+        if (size_ == 0) return used;
+
+        INT_TYPE first = capacity_ - front_;
+        if (first > size_) first = size_;
+
+        used.first = { buffer_ + front_, first };
+        used.second = { buffer_, size_ - first };
+        return used;
+    }
+
     iterator begin() {
         return iterator(buffer_, front_, 0, capacity_);
     }
@@ -108,9 +269,14 @@ public:
     }
 
     void clear() {
-        while (size_ > 0) {
-            pop();
+        policy_.on_clear((const void*)this, size_);
+
+        // call the destructors
+        for (INT_TYPE i = 0; i < size_; ++i) {
+            INT_TYPE index_rolling = (front_ + i) % capacity_;
+            buffer_[index_rolling].~T();
         }
+        size_ = 0;
         front_ = 0;
         back_ = 0;
     }
@@ -118,7 +284,8 @@ public:
     void push_back(const T& data) {
         should_reallocate();
 
-        buffer_[back_] = data;
+        new (&buffer_[back_]) T(data);
+        policy_.on_push((const void*)this, back_, (INT_TYPE)1, size_ + 1, capacity_);
         back_ = (back_ + 1) % capacity_;
         ++size_;
     }
@@ -129,6 +296,7 @@ public:
         T* data = new (&buffer_[back_]) T();
         if (data == nullptr) abort();
 
+        policy_.on_push((const void*)this, back_, (INT_TYPE)1, size_ + 1, capacity_);
         back_ = (back_ + 1) % capacity_;
         ++size_;
         return *data;
@@ -137,7 +305,8 @@ public:
     void push_back(T&& data) {
         should_reallocate();
 
-        buffer_[back_] = std::move(data); // this might be wrong
+        new (&buffer_[back_]) T(std::move(data));
+        policy_.on_push((const void*)this, back_, (INT_TYPE)1, size_ + 1, capacity_);
         back_ = (back_ + 1) % capacity_;
         ++size_;
     }
@@ -148,17 +317,65 @@ public:
         return buffer_[front_];
     }
 
+    // how far ahead drain and for_each prefetch by default, about 512 bytes
+    static constexpr INT_TYPE default_prefetch = sizeof(T) >= 256 ? 2 : (INT_TYPE)(512 / sizeof(T));
+
+    // func(T&) on every element front to back, prefetching prefetch_distance elements ahead (0 for none)
+    template<typename FuncElement>
+    void for_each(FuncElement func, INT_TYPE prefetch_distance = default_prefetch) {
+        prefetch_walk(segments(), prefetch_distance, func);
+    }
+
+    // func(T&) on every element front to back, each one is popped after func is done with it (so func can move from it).
+    // the same as a front()/pop() loop but without the modulo, and it prefetches
+    template<typename FuncElement>
+    void drain(FuncElement func, INT_TYPE prefetch_distance = default_prefetch) {
+        if (size_ == 0) return;
+
+        prefetch_walk(segments(), prefetch_distance, [&func](T& data) {
+            func(data);
+            data.~T();
+        });
+        policy_.on_pop((const void*)this, front_, size_, (INT_TYPE)0, capacity_);
+
+        size_ = 0;
+        front_ = 0;
+        back_ = 0;
+    }
+
+    // prefetches for writing the slot distance places after back_, for producers that are about to push a lot.
+    // it never grows the queue, slots past the capacity are skipped
+    void prefetch_back(INT_TYPE distance = default_prefetch) const noexcept {
+        if (distance >= capacity_ - size_) return;
+
+        INT_TYPE index_rolling = (back_ + distance) % capacity_;
+        NSTD_QUEUE_PREFETCH(buffer_ + index_rolling, 1);
+    }
+
     T& back() {
         assert(size_ != 0);
-        INT_TYPE last = (back_ + (size_ - 1)) % capacity_;
+        INT_TYPE last = (back_ + capacity_ - 1) % capacity_;
         return buffer_[last];
     }
 
+    // removes the newest element
+    void pop_back() {
+        assert(size_ != 0);
+
+        INT_TYPE last = (back_ + capacity_ - 1) % capacity_;
+        buffer_[last].~T();
+        policy_.on_pop((const void*)this, last, (INT_TYPE)1, size_ - 1, capacity_);
+
+        back_ = last;
+        --size_;
+    }
+
     void pop() {
         assert(size_ != 0);
 
         // call the destructor
         buffer_[front_].~T();
+        policy_.on_pop((const void*)this, front_, (INT_TYPE)1, size_ - 1, capacity_);
 
         front_ = (front_ + 1) % capacity_;
         --size_;
@@ -186,7 +403,7 @@ public:
         return buffer_[index_rolling];
     }
 
-    // TODO: basic algorithms without using iterators
+    // basic algorithms without iterators are in queue_algorithm.hpp, they work on segments()
 };
 }
 
@@ -195,7 +412,7 @@ public:
 namespace nstd {
 
     // accepts plain old data types only
-    template <class T, typename INT_TYPE = int>
+    template <class T, typename INT_TYPE = int, class Policy = queue_policy_none>
     struct queue_trivial {
         static_assert(std::is_fundamental<INT_TYPE>(), "INT_TYPE is not an integer");
         static_assert(std::is_trivial<T>(), "type in this queue is not trivial when it needs to be");
@@ -205,51 +422,141 @@ namespace nstd {
         INT_TYPE back_ = 0; // back is not inclusive, it is one element after the last element
         INT_TYPE capacity_ = 0;
         INT_TYPE size_ = 0;
+        [[no_unique_address]] Policy policy_;
 
         queue_trivial() noexcept {}
 
-        queue_trivial(const queue_trivial<T>& queue) = delete;
-        queue_trivial<T>& operator=(const queue_trivial<T>& queue) = delete;
-        queue_trivial<T>& operator=(queue_trivial<T>&& type) = delete;
+        queue_trivial(const queue_trivial& queue) = delete;
+        queue_trivial& operator=(const queue_trivial& queue) = delete;
+        queue_trivial& operator=(queue_trivial&& type) = delete;
 
         ~queue_trivial() {
             if (buffer_ == nullptr) return;
             free(buffer_);
         }
 
-        void should_reallocate() noexcept {
+        // moves the contents to a buffer of new_capacity, unrolled so the front ends up at 0
+        void reallocate(INT_TYPE new_capacity) noexcept {
+            assert(new_capacity > size_);
 
-            if (capacity_ == size_) {
+            T* buffer_new = (T*)malloc(sizeof(T) * new_capacity);
+            if (buffer_new == nullptr) abort();
 
-                if (capacity_ == 0) capacity_ = 2;
-                else capacity_ *= 2;
-                
-                T* buffer_new = (T*)malloc(sizeof(T) * capacity_);
-                if (buffer_new == nullptr) abort();
+            policy_.on_reallocate((const void*)this, front_, size_, capacity_, new_capacity, sizeof(T) * (size_t)size_);
 
-                // copy old buffer into new buffer 
-                // dont have to worry about insane copy semantics
-                memcpy(buffer_new, buffer_, sizeof(T) * size_);
+            // copy old buffer into new buffer, both pieces of it if it wraps
+            // dont have to worry about insane copy semantics
+            nstd::segments<T, INT_TYPE> used = segments();
+            if (used.first.size > 0) memcpy(buffer_new, used.first.data, sizeof(T) * used.first.size);
+            if (used.second.size > 0) memcpy(buffer_new + used.first.size, used.second.data, sizeof(T) * used.second.size);
 
-                // free the old buffer 
-                free(buffer_);
-                buffer_ = buffer_new;
+            // free the old buffer 
+            free(buffer_);
+            buffer_ = buffer_new;
+            capacity_ = new_capacity;
+
+            front_ = 0;
+            back_ = size_;
+        }
 
-                front_ = 0;
-                back_ = size_;
+        void should_reallocate() noexcept {
+
+            if (capacity_ == size_) {
+                reallocate(capacity_ == 0 ? 2 : capacity_ * 2);
             }
         }
     public:
 
+        // grows the same way pushing would (doubling) until there is room for count elements
+        void reserve(INT_TYPE count) noexcept {
+            if (count <= capacity_) return;
+
+            INT_TYPE new_capacity = capacity_ == 0 ? 2 : capacity_;
+            while (new_capacity < count) new_capacity *= 2;
+            reallocate(new_capacity);
+        }
+
         void clear() noexcept {
+            policy_.on_clear((const void*)this, size_);
             front_ = 0;
             back_ = 0;
+            size_ = 0;
+        }
+
+        // the elements as contiguous pieces: from front_ towards the end of the buffer, then the part that wrapped around
+        nstd::segments<T, INT_TYPE> segments() const noexcept {
+            nstd::segments<T, INT_TYPE> used;
+            if (size_ == 0) return used;
+
+            INT_TYPE first = capacity_ - front_;
+            if (first > size_) first = size_;
+
+            used.first = { buffer_ + front_, first };
+            used.second = { buffer_, size_ - first };
+            return used;
+        }
+
+        // the unused slots as contiguous pieces, starting at back_. write into them and then advance_back
+        nstd::segments<T, INT_TYPE> free_segments() const noexcept {
+            nstd::segments<T, INT_TYPE> unused;
+            INT_TYPE count = capacity_ - size_;
+            if (count == 0) return unused;
+
+            INT_TYPE first = capacity_ - back_;
+            if (first > count) first = count;
+
+            unused.first = { buffer_ + back_, first };
+            unused.second = { buffer_, count - first };
+            return unused;
+        }
+
+        // count elements were written into free_segments, they are now part of the queue
+        void advance_back(INT_TYPE count) noexcept {
+            assert(count >= 0 && count <= capacity_ - size_);
+            if (count == 0) return;
+
+            policy_.on_push((const void*)this, back_, count, size_ + count, capacity_);
+            back_ = (back_ + count) % capacity_;
+            size_ += count;
+        }
+
+        // count elements from the front are no longer needed (like calling pop count times)
+        void advance_front(INT_TYPE count) noexcept {
+            assert(count >= 0 && count <= size_);
+            if (count == 0) return;
+
+            policy_.on_pop((const void*)this, front_, count, size_ - count, capacity_);
+            front_ = (front_ + count) % capacity_;
+            size_ -= count;
+        }
+
+        INT_TYPE capacity() const noexcept {
+            return capacity_;
+        }
+
+        Policy& policy() noexcept {
+            return policy_;
+        }
+
+        const Policy& stats() const noexcept {
+            return policy_;
+        }
+
+        // swaps the buffers, no elements are copied
+        void swap(queue_trivial& other) noexcept {
+            std::swap(buffer_, other.buffer_);
+            std::swap(front_, other.front_);
+            std::swap(back_, other.back_);
+            std::swap(capacity_, other.capacity_);
+            std::swap(size_, other.size_);
+            std::swap(policy_, other.policy_);
         }
 
         void push_back(const T& data) noexcept {
             should_reallocate();
 
             buffer_[back_] = data;
+            policy_.on_push((const void*)this, back_, (INT_TYPE)1, size_ + 1, capacity_);
             back_ = (back_ + 1) % capacity_;
             ++size_;
         }
@@ -259,6 +566,7 @@ namespace nstd {
             should_reallocate();
 
             copy(buffer_[back_], data);
+            policy_.on_push((const void*)this, back_, (INT_TYPE)1, size_ + 1, capacity_);
 
           //  buffer_[back_] = data;
             back_ = (back_ + 1) % capacity_;
@@ -272,6 +580,7 @@ namespace nstd {
             T* data = &buffer_[back_];
 
             init(*data);
+            policy_.on_push((const void*)this, back_, (INT_TYPE)1, size_ + 1, capacity_);
 
             back_ = (back_ + 1) % capacity_;
             ++size_;
@@ -282,6 +591,7 @@ namespace nstd {
             should_reallocate();
 
             T* data = &buffer_[back_];
+            policy_.on_push((const void*)this, back_, (INT_TYPE)1, size_ + 1, capacity_);
 
             back_ = (back_ + 1) % capacity_;
             ++size_;
@@ -294,17 +604,55 @@ namespace nstd {
             return buffer_[front_];
         }
 
+        // how far ahead drain and for_each prefetch by default, about 512 bytes
+        static constexpr INT_TYPE default_prefetch = sizeof(T) >= 256 ? 2 : (INT_TYPE)(512 / sizeof(T));
+
+        // func(T&) on every element front to back, prefetching prefetch_distance elements ahead (0 for none)
+        template<typename FuncElement>
+        void for_each(FuncElement func, INT_TYPE prefetch_distance = default_prefetch) noexcept {
+            prefetch_walk(segments(), prefetch_distance, func);
+        }
+
+        // func(T&) on every element front to back and then they're all popped.
+        // the same as a front()/pop() loop but without the modulo, and it prefetches
+        template<typename FuncElement>
+        void drain(FuncElement func, INT_TYPE prefetch_distance = default_prefetch) noexcept {
+            prefetch_walk(segments(), prefetch_distance, func);
+            advance_front(size_);
+        }
+
+        // prefetches for writing the slot distance places after back_, for producers that are about to push a lot.
+        // it never grows the queue, slots past the capacity are skipped
+        void prefetch_back(INT_TYPE distance = default_prefetch) const noexcept {
+            if (distance >= capacity_ - size_) return;
+
+            INT_TYPE index_rolling = (back_ + distance) % capacity_;
+            NSTD_QUEUE_PREFETCH(buffer_ + index_rolling, 1);
+        }
+
         T& back() noexcept {
             assert(size_ != 0);
-            INT_TYPE last = (back_ + (size_ - 1)) % capacity_;
+            INT_TYPE last = (back_ + capacity_ - 1) % capacity_;
             return buffer_[last];
         }
 
+        // removes the newest element
+        void pop_back() noexcept {
+            assert(size_ != 0);
+
+            INT_TYPE last = (back_ + capacity_ - 1) % capacity_;
+            policy_.on_pop((const void*)this, last, (INT_TYPE)1, size_ - 1, capacity_);
+
+            back_ = last;
+            --size_;
+        }
+
         template<typename FuncDeinit>
         void pop(FuncDeinit deinit) noexcept {
             assert(size_ != 0);
 
             deinit(buffer_[front_]);
+            policy_.on_pop((const void*)this, front_, (INT_TYPE)1, size_ - 1, capacity_);
 
             front_ = (front_ + 1) % capacity_;
             --size_;
@@ -313,6 +661,7 @@ namespace nstd {
         void pop() noexcept {
             assert(size_ != 0);
 
+            policy_.on_pop((const void*)this, front_, (INT_TYPE)1, size_ - 1, capacity_);
             front_ = (front_ + 1) % capacity_;
             --size_;
         }
@@ -0,0 +1,473 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "queue.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define NSTD_QUEUE_AVX2 1
+#include <immintrin.h>
+#endif
+
+// searching and reducing over a queue without iterators or operator[], so there's no modulo per element.
+// everything works on the (up to two) contiguous pieces from segments(), for queue and queue_trivial alike.
+//
+// for float, double, int32_t and int64_t the pieces go through AVX2 kernels when the cpu has AVX2 (checked once
+// at runtime), otherwise through the plain loops below, which the compiler vectorises with whatever the build targets.
+// sums of floating point values are added up in several lanes, so the result can differ in the last bits from
+// adding them one by one. min/max with NaNs in the queue are unspecified.
+namespace nstd {
+
+    // plain loops over one piece. find returns count when it's not there
+    template<class T>
+    size_t span_find(const T* data, size_t count, const T& value) noexcept {
+        for (size_t i = 0; i < count; ++i) {
+            if (data[i] == value) return i;
+        }
+        return count;
+    }
+
+    template<class T>
+    size_t span_count(const T* data, size_t count, const T& value) noexcept {
+        size_t matches = 0;
+        for (size_t i = 0; i < count; ++i) {
+            matches += data[i] == value;
+        }
+        return matches;
+    }
+
+    // signed integers are added up as their unsigned type, so a sum that overflows wraps around instead of being
+    // undefined. it's the same wrap the AVX2 kernels give
+    template<class T>
+    using sum_type = typename std::conditional_t<std::is_integral_v<T> && std::is_signed_v<T>, std::make_unsigned<T>, std::type_identity<T>>::type;
+
+    template<class T>
+    T span_sum(const T* data, size_t count) noexcept {
+        sum_type<T> total = sum_type<T>();
+        for (size_t i = 0; i < count; ++i) {
+            total += (sum_type<T>)data[i];
+        }
+        return (T)total;
+    }
+
+    // count > 0
+    template<class T>
+    T span_min(const T* data, size_t count) noexcept {
+        T result = data[0];
+        for (size_t i = 1; i < count; ++i) {
+            result = data[i] < result ? data[i] : result;
+        }
+        return result;
+    }
+
+    template<class T>
+    T span_max(const T* data, size_t count) noexcept {
+        T result = data[0];
+        for (size_t i = 1; i < count; ++i) {
+            result = result < data[i] ? data[i] : result;
+        }
+        return result;
+    }
+
+#if defined(NSTD_QUEUE_AVX2)
+
+    inline bool has_avx2() noexcept {
+        static const bool avx2 = __builtin_cpu_supports("avx2");
+        return avx2;
+    }
+
+    // the same five kernels for each type, 32 bytes at a time with the plain loop for the leftovers.
+    // only called when has_avx2() is true
+
+    __attribute__((target("avx2"))) inline size_t span_find_avx2(const float* data, size_t count, float value) noexcept {
+        __m256 wanted = _mm256_set1_ps(value);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            int mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(data + i), wanted, _CMP_EQ_OQ));
+            if (mask != 0) return i + __builtin_ctz(mask);
+        }
+        return i + span_find(data + i, count - i, value);
+    }
+
+    __attribute__((target("avx2"))) inline size_t span_count_avx2(const float* data, size_t count, float value) noexcept {
+        __m256 wanted = _mm256_set1_ps(value);
+        size_t matches = 0;
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            matches += __builtin_popcount(_mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(data + i), wanted, _CMP_EQ_OQ)));
+        }
+        return matches + span_count(data + i, count - i, value);
+    }
+
+    __attribute__((target("avx2"))) inline float span_sum_avx2(const float* data, size_t count) noexcept {
+        __m256 a = _mm256_setzero_ps();
+        __m256 b = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            a = _mm256_add_ps(a, _mm256_loadu_ps(data + i));
+            b = _mm256_add_ps(b, _mm256_loadu_ps(data + i + 8));
+        }
+        for (; i + 8 <= count; i += 8) {
+            a = _mm256_add_ps(a, _mm256_loadu_ps(data + i));
+        }
+
+        float lanes[8];
+        _mm256_storeu_ps(lanes, _mm256_add_ps(a, b));
+        return span_sum(lanes, 8) + span_sum(data + i, count - i);
+    }
+
+    __attribute__((target("avx2"))) inline float span_min_avx2(const float* data, size_t count) noexcept {
+        if (count < 8) return span_min(data, count);
+
+        __m256 result = _mm256_loadu_ps(data);
+        size_t i = 8;
+        for (; i + 8 <= count; i += 8) {
+            result = _mm256_min_ps(result, _mm256_loadu_ps(data + i));
+        }
+
+        float lanes[9];
+        _mm256_storeu_ps(lanes, result);
+        lanes[8] = i < count ? span_min(data + i, count - i) : lanes[0];
+        return span_min(lanes, 9);
+    }
+
+    __attribute__((target("avx2"))) inline float span_max_avx2(const float* data, size_t count) noexcept {
+        if (count < 8) return span_max(data, count);
+
+        __m256 result = _mm256_loadu_ps(data);
+        size_t i = 8;
+        for (; i + 8 <= count; i += 8) {
+            result = _mm256_max_ps(result, _mm256_loadu_ps(data + i));
+        }
+
+        float lanes[9];
+        _mm256_storeu_ps(lanes, result);
+        lanes[8] = i < count ? span_max(data + i, count - i) : lanes[0];
+        return span_max(lanes, 9);
+    }
+
+    __attribute__((target("avx2"))) inline size_t span_find_avx2(const double* data, size_t count, double value) noexcept {
+        __m256d wanted = _mm256_set1_pd(value);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            int mask = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(data + i), wanted, _CMP_EQ_OQ));
+            if (mask != 0) return i + __builtin_ctz(mask);
+        }
+        return i + span_find(data + i, count - i, value);
+    }
+
+    __attribute__((target("avx2"))) inline size_t span_count_avx2(const double* data, size_t count, double value) noexcept {
+        __m256d wanted = _mm256_set1_pd(value);
+        size_t matches = 0;
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            matches += __builtin_popcount(_mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(data + i), wanted, _CMP_EQ_OQ)));
+        }
+        return matches + span_count(data + i, count - i, value);
+    }
+
+    __attribute__((target("avx2"))) inline double span_sum_avx2(const double* data, size_t count) noexcept {
+        __m256d a = _mm256_setzero_pd();
+        __m256d b = _mm256_setzero_pd();
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            a = _mm256_add_pd(a, _mm256_loadu_pd(data + i));
+            b = _mm256_add_pd(b, _mm256_loadu_pd(data + i + 4));
+        }
+        for (; i + 4 <= count; i += 4) {
+            a = _mm256_add_pd(a, _mm256_loadu_pd(data + i));
+        }
+
+        double lanes[4];
+        _mm256_storeu_pd(lanes, _mm256_add_pd(a, b));
+        return span_sum(lanes, 4) + span_sum(data + i, count - i);
+    }
+
+    __attribute__((target("avx2"))) inline double span_min_avx2(const double* data, size_t count) noexcept {
+        if (count < 4) return span_min(data, count);
+
+        __m256d result = _mm256_loadu_pd(data);
+        size_t i = 4;
+        for (; i + 4 <= count; i += 4) {
+            result = _mm256_min_pd(result, _mm256_loadu_pd(data + i));
+        }
+
+        double lanes[5];
+        _mm256_storeu_pd(lanes, result);
+        lanes[4] = i < count ? span_min(data + i, count - i) : lanes[0];
+        return span_min(lanes, 5);
+    }
+
+    __attribute__((target("avx2"))) inline double span_max_avx2(const double* data, size_t count) noexcept {
+        if (count < 4) return span_max(data, count);
+
+        __m256d result = _mm256_loadu_pd(data);
+        size_t i = 4;
+        for (; i + 4 <= count; i += 4) {
+            result = _mm256_max_pd(result, _mm256_loadu_pd(data + i));
+        }
+
+        double lanes[5];
+        _mm256_storeu_pd(lanes, result);
+        lanes[4] = i < count ? span_max(data + i, count - i) : lanes[0];
+        return span_max(lanes, 5);
+    }
+
+    __attribute__((target("avx2"))) inline size_t span_find_avx2(const int32_t* data, size_t count, int32_t value) noexcept {
+        __m256i wanted = _mm256_set1_epi32(value);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256i equal = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(data + i)), wanted);
+            int mask = _mm256_movemask_ps(_mm256_castsi256_ps(equal));
+            if (mask != 0) return i + __builtin_ctz(mask);
+        }
+        return i + span_find(data + i, count - i, value);
+    }
+
+    __attribute__((target("avx2"))) inline size_t span_count_avx2(const int32_t* data, size_t count, int32_t value) noexcept {
+        __m256i wanted = _mm256_set1_epi32(value);
+        size_t matches = 0;
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256i equal = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*)(data + i)), wanted);
+            matches += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(equal)));
+        }
+        return matches + span_count(data + i, count - i, value);
+    }
+
+    // wraps on overflow like adding them one by one into an int32_t would
+    __attribute__((target("avx2"))) inline int32_t span_sum_avx2(const int32_t* data, size_t count) noexcept {
+        __m256i total = _mm256_setzero_si256();
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            total = _mm256_add_epi32(total, _mm256_loadu_si256((const __m256i*)(data + i)));
+        }
+
+        uint32_t lanes[8];
+        _mm256_storeu_si256((__m256i*)lanes, total);
+        uint32_t result = span_sum(lanes, 8);
+        for (; i < count; ++i) result += (uint32_t)data[i];
+        return (int32_t)result;
+    }
+
+    __attribute__((target("avx2"))) inline int32_t span_min_avx2(const int32_t* data, size_t count) noexcept {
+        if (count < 8) return span_min(data, count);
+
+        __m256i result = _mm256_loadu_si256((const __m256i*)data);
+        size_t i = 8;
+        for (; i + 8 <= count; i += 8) {
+            result = _mm256_min_epi32(result, _mm256_loadu_si256((const __m256i*)(data + i)));
+        }
+
+        int32_t lanes[9];
+        _mm256_storeu_si256((__m256i*)lanes, result);
+        lanes[8] = i < count ? span_min(data + i, count - i) : lanes[0];
+        return span_min(lanes, 9);
+    }
+
+    __attribute__((target("avx2"))) inline int32_t span_max_avx2(const int32_t* data, size_t count) noexcept {
+        if (count < 8) return span_max(data, count);
+
+        __m256i result = _mm256_loadu_si256((const __m256i*)data);
+        size_t i = 8;
+        for (; i + 8 <= count; i += 8) {
+            result = _mm256_max_epi32(result, _mm256_loadu_si256((const __m256i*)(data + i)));
+        }
+
+        int32_t lanes[9];
+        _mm256_storeu_si256((__m256i*)lanes, result);
+        lanes[8] = i < count ? span_max(data + i, count - i) : lanes[0];
+        return span_max(lanes, 9);
+    }
+
+    __attribute__((target("avx2"))) inline size_t span_find_avx2(const int64_t* data, size_t count, int64_t value) noexcept {
+        __m256i wanted = _mm256_set1_epi64x(value);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m256i equal = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)(data + i)), wanted);
+            int mask = _mm256_movemask_pd(_mm256_castsi256_pd(equal));
+            if (mask != 0) return i + __builtin_ctz(mask);
+        }
+        return i + span_find(data + i, count - i, value);
+    }
+
+    __attribute__((target("avx2"))) inline size_t span_count_avx2(const int64_t* data, size_t count, int64_t value) noexcept {
+        __m256i wanted = _mm256_set1_epi64x(value);
+        size_t matches = 0;
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m256i equal = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)(data + i)), wanted);
+            matches += __builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(equal)));
+        }
+        return matches + span_count(data + i, count - i, value);
+    }
+
+    __attribute__((target("avx2"))) inline int64_t span_sum_avx2(const int64_t* data, size_t count) noexcept {
+        __m256i total = _mm256_setzero_si256();
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            total = _mm256_add_epi64(total, _mm256_loadu_si256((const __m256i*)(data + i)));
+        }
+
+        uint64_t lanes[4];
+        _mm256_storeu_si256((__m256i*)lanes, total);
+        uint64_t result = span_sum(lanes, 4);
+        for (; i < count; ++i) result += (uint64_t)data[i];
+        return (int64_t)result;
+    }
+
+    // no min/max instruction for 64 bit lanes in AVX2, compare and blend instead
+    __attribute__((target("avx2"))) inline int64_t span_min_avx2(const int64_t* data, size_t count) noexcept {
+        if (count < 4) return span_min(data, count);
+
+        __m256i result = _mm256_loadu_si256((const __m256i*)data);
+        size_t i = 4;
+        for (; i + 4 <= count; i += 4) {
+            __m256i values = _mm256_loadu_si256((const __m256i*)(data + i));
+            result = _mm256_blendv_epi8(result, values, _mm256_cmpgt_epi64(result, values));
+        }
+
+        int64_t lanes[5];
+        _mm256_storeu_si256((__m256i*)lanes, result);
+        lanes[4] = i < count ? span_min(data + i, count - i) : lanes[0];
+        return span_min(lanes, 5);
+    }
+
+    __attribute__((target("avx2"))) inline int64_t span_max_avx2(const int64_t* data, size_t count) noexcept {
+        if (count < 4) return span_max(data, count);
+
+        __m256i result = _mm256_loadu_si256((const __m256i*)data);
+        size_t i = 4;
+        for (; i + 4 <= count; i += 4) {
+            __m256i values = _mm256_loadu_si256((const __m256i*)(data + i));
+            result = _mm256_blendv_epi8(result, values, _mm256_cmpgt_epi64(values, result));
+        }
+
+        int64_t lanes[5];
+        _mm256_storeu_si256((__m256i*)lanes, result);
+        lanes[4] = i < count ? span_max(data + i, count - i) : lanes[0];
+        return span_max(lanes, 5);
+    }
+
+    // the types with kernels go to them when the cpu allows, these overloads win over the templates above
+#define NSTD_QUEUE_AVX2_DISPATCH(T) \
+    inline size_t span_find(const T* data, size_t count, const T& value) noexcept { \
+        if (has_avx2()) return span_find_avx2(data, count, value); \
+        return span_find<T>(data, count, value); \
+    } \
+    inline size_t span_count(const T* data, size_t count, const T& value) noexcept { \
+        if (has_avx2()) return span_count_avx2(data, count, value); \
+        return span_count<T>(data, count, value); \
+    } \
+    inline T span_sum(const T* data, size_t count) noexcept { \
+        if (has_avx2()) return span_sum_avx2(data, count); \
+        return span_sum<T>(data, count); \
+    } \
+    inline T span_min(const T* data, size_t count) noexcept { \
+        if (has_avx2()) return span_min_avx2(data, count); \
+        return span_min<T>(data, count); \
+    } \
+    inline T span_max(const T* data, size_t count) noexcept { \
+        if (has_avx2()) return span_max_avx2(data, count); \
+        return span_max<T>(data, count); \
+    }
+
+    NSTD_QUEUE_AVX2_DISPATCH(float)
+    NSTD_QUEUE_AVX2_DISPATCH(double)
+    NSTD_QUEUE_AVX2_DISPATCH(int32_t)
+    NSTD_QUEUE_AVX2_DISPATCH(int64_t)
+
+#undef NSTD_QUEUE_AVX2_DISPATCH
+
+#endif
+
+    // index of the first element equal to value, size() if there isn't one (like span_find, and whatever INT_TYPE is)
+    template<class T, typename INT_TYPE>
+    INT_TYPE find(const segments<T, INT_TYPE>& pieces, const std::type_identity_t<T>& value) noexcept {
+        size_t first = span_find((const T*)pieces.first.data, (size_t)pieces.first.size, value);
+        if (first < (size_t)pieces.first.size) return (INT_TYPE)first;
+
+        size_t second = span_find((const T*)pieces.second.data, (size_t)pieces.second.size, value);
+        return pieces.first.size + (INT_TYPE)second;
+    }
+
+    template<class T, typename INT_TYPE>
+    INT_TYPE count(const segments<T, INT_TYPE>& pieces, const std::type_identity_t<T>& value) noexcept {
+        return (INT_TYPE)(span_count((const T*)pieces.first.data, (size_t)pieces.first.size, value)
+            + span_count((const T*)pieces.second.data, (size_t)pieces.second.size, value));
+    }
+
+    template<class T, typename INT_TYPE>
+    T sum(const segments<T, INT_TYPE>& pieces) noexcept {
+        sum_type<T> first = (sum_type<T>)span_sum((const T*)pieces.first.data, (size_t)pieces.first.size);
+        sum_type<T> second = (sum_type<T>)span_sum((const T*)pieces.second.data, (size_t)pieces.second.size);
+        return (T)(first + second);
+    }
+
+    // the queue can't be empty
+    template<class T, typename INT_TYPE>
+    T min(const segments<T, INT_TYPE>& pieces) noexcept {
+        assert(pieces.size() != 0);
+        if (pieces.first.size == 0) return span_min((const T*)pieces.second.data, (size_t)pieces.second.size);
+
+        T result = span_min((const T*)pieces.first.data, (size_t)pieces.first.size);
+        if (pieces.second.size == 0) return result;
+
+        T second = span_min((const T*)pieces.second.data, (size_t)pieces.second.size);
+        return second < result ? second : result;
+    }
+
+    template<class T, typename INT_TYPE>
+    T max(const segments<T, INT_TYPE>& pieces) noexcept {
+        assert(pieces.size() != 0);
+        if (pieces.first.size == 0) return span_max((const T*)pieces.second.data, (size_t)pieces.second.size);
+
+        T result = span_max((const T*)pieces.first.data, (size_t)pieces.first.size);
+        if (pieces.second.size == 0) return result;
+
+        T second = span_max((const T*)pieces.second.data, (size_t)pieces.second.size);
+        return result < second ? second : result;
+    }
+
+    // any predicate, so no kernels, but still a straight loop over each piece
+    template<class T, typename INT_TYPE, typename FuncPredicate>
+    bool any_of(const segments<T, INT_TYPE>& pieces, FuncPredicate predicate) {
+        for (const T& value : pieces.first) {
+            if (predicate(value)) return true;
+        }
+        for (const T& value : pieces.second) {
+            if (predicate(value)) return true;
+        }
+        return false;
+    }
+
+    // the same on a whole queue (queue or queue_trivial)
+    template<class Queue, class V>
+    auto find(const Queue& q, const V& value) noexcept -> decltype(find(q.segments(), value)) {
+        return find(q.segments(), value);
+    }
+
+    template<class Queue, class V>
+    auto count(const Queue& q, const V& value) noexcept -> decltype(count(q.segments(), value)) {
+        return count(q.segments(), value);
+    }
+
+    template<class Queue>
+    auto sum(const Queue& q) noexcept -> decltype(sum(q.segments())) {
+        return sum(q.segments());
+    }
+
+    template<class Queue>
+    auto min(const Queue& q) noexcept -> decltype(min(q.segments())) {
+        return min(q.segments());
+    }
+
+    template<class Queue>
+    auto max(const Queue& q) noexcept -> decltype(max(q.segments())) {
+        return max(q.segments());
+    }
+
+    template<class Queue, typename FuncPredicate>
+    auto any_of(const Queue& q, FuncPredicate predicate) -> decltype(any_of(q.segments(), predicate)) {
+        return any_of(q.segments(), predicate);
+    }
+}
@@ -0,0 +1,260 @@
+#pragma once
+#include <errno.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include "queue.hpp"
+
+// file descriptor I/O straight into and out of a byte queue (posix only).
+// reads land directly in the free space after back_ and writes go directly from the elements after front_,
+// using readv/writev over the (up to two) pieces so there's no bounce buffer and no wrap around copy.
+//
+// also snapshots: save/load a whole queue to an fd or a stream. a snapshot is a small header and then the elements
+// in order. for queue_trivial that's a raw dump of the two pieces. queue<T> has no raw layout, it takes functions
+// that write and read one element. the count in a header isn't trusted: loading grows as the elements actually
+// arrive, a bounded chunk at a time, and only replaces the queue's contents once all of them are in. a failed load
+// leaves the queue as it was.
+namespace nstd {
+
+    struct snapshot_header {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t element_size; // 0 when the elements were written by a save function
+        int64_t count;
+    };
+
+    constexpr uint64_t snapshot_magic = 0x746f687370616e73ull; // "snapshot"
+    constexpr uint32_t snapshot_version = 1;
+
+    template<class T, typename INT_TYPE>
+    int segments_to_iovec(const segments<T, INT_TYPE>& pieces, iovec* iov) noexcept {
+        int count = 0;
+        if (pieces.first.size > 0) {
+            iov[count].iov_base = (void*)pieces.first.data;
+            iov[count].iov_len = sizeof(T) * pieces.first.size;
+            ++count;
+        }
+        if (pieces.second.size > 0) {
+            iov[count].iov_base = (void*)pieces.second.data;
+            iov[count].iov_len = sizeof(T) * pieces.second.size;
+            ++count;
+        }
+        return count;
+    }
+
+    // one readv into the free space. the queue grows first (doubling) if there are fewer than min_free bytes free.
+    // returns what readv returned: bytes read, 0 at end of file, -1 with errno set (EAGAIN on an empty non blocking fd)
+    template<class T, typename INT_TYPE, class Policy>
+    ssize_t read_from_fd(queue_trivial<T, INT_TYPE, Policy>& q, int fd, INT_TYPE min_free = 4096) noexcept {
+        static_assert(sizeof(T) == 1, "fd I/O is for byte queues");
+
+        if (q.capacity() - q.size() < min_free) q.reserve(q.size() + min_free);
+
+        iovec iov[2];
+        int count = segments_to_iovec(q.free_segments(), iov);
+
+        ssize_t result;
+        do {
+            result = readv(fd, iov, count);
+        } while (result < 0 && errno == EINTR);
+
+        if (result > 0) q.advance_back((INT_TYPE)result);
+        return result;
+    }
+
+    // one writev of everything in the queue. whatever was written is popped, a short write leaves the rest queued.
+    // returns what writev returned, or 0 without a syscall if the queue is empty
+    template<class T, typename INT_TYPE, class Policy>
+    ssize_t write_to_fd(queue_trivial<T, INT_TYPE, Policy>& q, int fd) noexcept {
+        static_assert(sizeof(T) == 1, "fd I/O is for byte queues");
+
+        if (q.empty()) return 0;
+
+        iovec iov[2];
+        int count = segments_to_iovec(q.segments(), iov);
+
+        ssize_t result;
+        do {
+            result = writev(fd, iov, count);
+        } while (result < 0 && errno == EINTR);
+
+        if (result > 0) q.advance_front((INT_TYPE)result);
+        return result;
+    }
+
+    // writes count bytes starting at the iovecs, carrying on after short writes
+    inline int writev_fully(int fd, iovec* iov, int count) noexcept {
+        while (count > 0) {
+            ssize_t written = writev(fd, iov, count);
+            if (written < 0 && errno == EINTR) continue;
+            if (written < 0) return -errno;
+
+            while (count > 0 && (size_t)written >= iov->iov_len) {
+                written -= iov->iov_len;
+                ++iov;
+                --count;
+            }
+            if (count > 0) {
+                iov->iov_base = (char*)iov->iov_base + written;
+                iov->iov_len -= written;
+            }
+        }
+        return 0;
+    }
+
+    inline int read_fully(int fd, void* data, size_t size) noexcept {
+        char* bytes = (char*)data;
+        while (size > 0) {
+            ssize_t got = read(fd, bytes, size);
+            if (got < 0 && errno == EINTR) continue;
+            if (got < 0) return -errno;
+            if (got == 0) return -EBADMSG; // snapshot is cut short
+
+            bytes += got;
+            size -= (size_t)got;
+        }
+        return 0;
+    }
+
+    // whether a queue with an INT_TYPE size can hold count elements of element_size bytes (0 for ones written by a
+    // save function). capacities are powers of two, so the biggest one is the largest power of two INT_TYPE holds
+    template<typename INT_TYPE>
+    bool snapshot_count_fits(int64_t count, size_t element_size) noexcept {
+        if (count < 0) return false;
+
+        uint64_t max_capacity = (uint64_t)(std::numeric_limits<INT_TYPE>::max() / 2) + 1;
+        if ((uint64_t)count > max_capacity) return false;
+        return element_size == 0 || (uint64_t)count <= SIZE_MAX / element_size;
+    }
+
+    // how many elements a load reads before growing again
+    template<class T>
+    constexpr int64_t snapshot_chunk_elements() noexcept {
+        return sizeof(T) >= (1 << 20) ? 1 : (1 << 20) / sizeof(T);
+    }
+
+    // reads count elements with read_bytes(void*, size_t) (0 or a negative errno) into a separate queue, then
+    // replaces the contents of q with them. q isn't touched if anything fails
+    template<class T, typename INT_TYPE, class Policy, typename FuncRead>
+    int load_elements(queue_trivial<T, INT_TYPE, Policy>& q, int64_t count, FuncRead read_bytes) {
+        // nothing is ever popped, so the free space is always one piece right after the elements
+        queue_trivial<T, INT_TYPE> loaded;
+        while (loaded.size() < count) {
+            INT_TYPE chunk = (INT_TYPE)std::min(count - (int64_t)loaded.size(), snapshot_chunk_elements<T>());
+            loaded.reserve(loaded.size() + chunk);
+
+            int error = read_bytes(loaded.free_segments().first.data, sizeof(T) * (size_t)chunk);
+            if (error != 0) return error;
+            loaded.advance_back(chunk);
+        }
+
+        // front_ ends up at 0 and the elements are contiguous
+        q.clear();
+        if (count == 0) return 0;
+        q.reserve((INT_TYPE)count);
+        memcpy(q.free_segments().first.data, loaded.segments().first.data, sizeof(T) * (size_t)count);
+        q.advance_back((INT_TYPE)count);
+        return 0;
+    }
+
+    // header and both pieces in one writev. returns 0 or a negative errno
+    template<class T, typename INT_TYPE, class Policy>
+    int save(const queue_trivial<T, INT_TYPE, Policy>& q, int fd) noexcept {
+        snapshot_header header = { snapshot_magic, snapshot_version, (uint32_t)sizeof(T), (int64_t)q.size() };
+
+        iovec iov[3];
+        iov[0].iov_base = &header;
+        iov[0].iov_len = sizeof(header);
+        int count = 1 + segments_to_iovec(q.segments(), iov + 1);
+
+        return writev_fully(fd, iov, count);
+    }
+
+    // replaces the contents of q. returns 0 or a negative errno, -EBADMSG if it isn't a snapshot of this type or
+    // it's cut short. q is unchanged unless it returns 0
+    template<class T, typename INT_TYPE, class Policy>
+    int load(queue_trivial<T, INT_TYPE, Policy>& q, int fd) noexcept {
+        snapshot_header header;
+        int error = read_fully(fd, &header, sizeof(header));
+        if (error != 0) return error;
+        if (header.magic != snapshot_magic || header.version != snapshot_version || header.element_size != sizeof(T)) return -EBADMSG;
+        if (!snapshot_count_fits<INT_TYPE>(header.count, sizeof(T))) return -EBADMSG;
+
+        // a regular file says how much is left, so a count that can't be there fails before anything is allocated
+        struct stat info;
+        off_t position = lseek(fd, 0, SEEK_CUR);
+        if (position >= 0 && fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+            if ((uint64_t)header.count > (uint64_t)(info.st_size - position) / sizeof(T)) return -EBADMSG;
+        }
+
+        return load_elements(q, header.count, [fd](void* data, size_t size) {
+            return read_fully(fd, data, size);
+        });
+    }
+
+    template<class T, typename INT_TYPE, class Policy>
+    bool save(const queue_trivial<T, INT_TYPE, Policy>& q, std::ostream& out) {
+        snapshot_header header = { snapshot_magic, snapshot_version, (uint32_t)sizeof(T), (int64_t)q.size() };
+        out.write((const char*)&header, sizeof(header));
+
+        segments<T, INT_TYPE> used = q.segments();
+        out.write((const char*)used.first.data, sizeof(T) * (size_t)used.first.size);
+        out.write((const char*)used.second.data, sizeof(T) * (size_t)used.second.size);
+        return out.good();
+    }
+
+    // q is unchanged unless it returns true
+    template<class T, typename INT_TYPE, class Policy>
+    bool load(queue_trivial<T, INT_TYPE, Policy>& q, std::istream& in) {
+        snapshot_header header;
+        if (!in.read((char*)&header, sizeof(header))) return false;
+        if (header.magic != snapshot_magic || header.version != snapshot_version || header.element_size != sizeof(T)) return false;
+        if (!snapshot_count_fits<INT_TYPE>(header.count, sizeof(T))) return false;
+
+        return load_elements(q, header.count, [&in](void* data, size_t size) {
+            return in.read((char*)data, (std::streamsize)size) ? 0 : -EBADMSG;
+        }) == 0;
+    }
+
+    // save_element(std::ostream&, const T&) writes one element however it wants
+    template<class T, typename INT_TYPE, class Policy, typename FuncSave>
+    bool save(queue<T, INT_TYPE, Policy>& q, std::ostream& out, FuncSave save_element) {
+        snapshot_header header = { snapshot_magic, snapshot_version, 0, (int64_t)q.size() };
+        out.write((const char*)&header, sizeof(header));
+
+        for (INT_TYPE i = 0; i < q.size(); ++i) {
+            save_element(out, (const T&)q[i]);
+        }
+        return out.good();
+    }
+
+    // replaces the contents of q. load_element(std::istream&, T&) fills in a default constructed element.
+    // q is unchanged unless it returns true
+    template<class T, typename INT_TYPE, class Policy, typename FuncLoad>
+    bool load(queue<T, INT_TYPE, Policy>& q, std::istream& in, FuncLoad load_element) {
+        snapshot_header header;
+        if (!in.read((char*)&header, sizeof(header))) return false;
+        if (header.magic != snapshot_magic || header.version != snapshot_version || header.element_size != 0) return false;
+        if (!snapshot_count_fits<INT_TYPE>(header.count, 0)) return false;
+
+        // grows by doubling as elements arrive rather than reserving count
+        queue<T, INT_TYPE> loaded;
+        for (int64_t i = 0; i < header.count; ++i) {
+            load_element(in, loaded.emplace_back());
+            if (!in) return false;
+        }
+
+        q.clear();
+        q.reserve(loaded.size());
+        for (INT_TYPE i = 0; i < loaded.size(); ++i) {
+            q.push_back(std::move(loaded[i]));
+        }
+        return true;
+    }
+}
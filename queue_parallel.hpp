@@ -0,0 +1,182 @@
+#pragma once
+#include <thread>
+#include <type_traits>
+#include "queue.hpp"
+
+// for_each, transform_inplace and reduce over a whole queue, optionally spread over threads.
+// like queue_algorithm.hpp they work on the (up to two) contiguous pieces from segments(), so there's no
+// modulo per element. with a parallel policy the queue is cut into one range of about size / threads
+// elements per thread (a multiple of a cache line worth of elements, so neighbours don't write to the same line)
+// and the calling thread takes the first range itself.
+//
+// the policies are the ones from <execution> in spirit, but they're our own tags: libstdc++'s <execution> drags in
+// TBB at link time just for being included. define NSTD_QUEUE_STD_EXECUTION before including this to also
+// accept std::execution::seq/par/par_unseq/unseq.
+//
+// threads are started for every call, that's tens of microseconds, which is nothing next to a queue of millions
+// but a lot for a small one. so queues with fewer than min_per_thread elements per thread use fewer threads.
+#if defined(NSTD_QUEUE_STD_EXECUTION)
+#include <execution>
+#endif
+
+namespace nstd {
+
+    namespace execution {
+        struct sequenced_policy {};
+        struct parallel_policy {};
+        struct parallel_unsequenced_policy {};
+
+        inline constexpr sequenced_policy seq{};
+        inline constexpr parallel_policy par{};
+        inline constexpr parallel_unsequenced_policy par_unseq{};
+    }
+
+    template<class Policy> struct is_execution_policy : std::false_type {};
+    template<> struct is_execution_policy<execution::sequenced_policy> : std::true_type {};
+    template<> struct is_execution_policy<execution::parallel_policy> : std::true_type {};
+    template<> struct is_execution_policy<execution::parallel_unsequenced_policy> : std::true_type {};
+
+    template<class Policy> struct is_parallel_policy : std::false_type {};
+    template<> struct is_parallel_policy<execution::parallel_policy> : std::true_type {};
+    template<> struct is_parallel_policy<execution::parallel_unsequenced_policy> : std::true_type {};
+
+#if defined(NSTD_QUEUE_STD_EXECUTION)
+    template<> struct is_execution_policy<std::execution::sequenced_policy> : std::true_type {};
+    template<> struct is_execution_policy<std::execution::parallel_policy> : std::true_type {};
+    template<> struct is_execution_policy<std::execution::parallel_unsequenced_policy> : std::true_type {};
+    template<> struct is_parallel_policy<std::execution::parallel_policy> : std::true_type {};
+    template<> struct is_parallel_policy<std::execution::parallel_unsequenced_policy> : std::true_type {};
+#if defined(__cpp_lib_execution) && __cpp_lib_execution >= 201902L
+    template<> struct is_execution_policy<std::execution::unsequenced_policy> : std::true_type {};
+#endif
+#endif
+
+    template<class Policy, class Result = void>
+    using if_execution_policy = std::enable_if_t<is_execution_policy<std::remove_cvref_t<Policy>>::value, Result>;
+
+    constexpr int min_per_thread = 1 << 15;
+
+    // calls func(T* data, INT_TYPE count) for the pieces of elements begin to end
+    template<class T, typename INT_TYPE, typename FuncSpan>
+    void for_each_span(const segments<T, INT_TYPE>& pieces, INT_TYPE begin, INT_TYPE end, FuncSpan func) {
+        assert(begin >= 0 && begin <= end && end <= pieces.size());
+
+        if (begin < pieces.first.size) {
+            INT_TYPE last = end < pieces.first.size ? end : pieces.first.size;
+            func(pieces.first.data + begin, last - begin);
+        }
+        if (end > pieces.first.size) {
+            INT_TYPE first = begin > pieces.first.size ? begin - pieces.first.size : 0;
+            func(pieces.second.data + first, end - pieces.first.size - first);
+        }
+    }
+
+    // how many threads a queue of size elements gets. threads 0 means one per hardware thread
+    inline int thread_count(int64_t size, int threads) noexcept {
+        if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+        if (threads <= 0) threads = 1;
+
+        int64_t useful = size / min_per_thread;
+        if (useful < 1) useful = 1;
+        return useful < threads ? (int)useful : threads;
+    }
+
+    // calls func(int index, INT_TYPE begin, INT_TYPE end) for threads ranges covering 0 to size.
+    // range 0 runs on the calling thread, the others on their own threads
+    template<class T, typename INT_TYPE, typename FuncRange>
+    void split_ranges(INT_TYPE size, int threads, FuncRange func) {
+        constexpr INT_TYPE line = sizeof(T) >= 64 ? 1 : (INT_TYPE)(64 / sizeof(T));
+
+        INT_TYPE per_thread = size / threads;
+        per_thread = (per_thread + line - 1) / line * line;
+
+        queue<std::thread> workers;
+        workers.reserve(threads);
+        for (int i = 1; i < threads; ++i) {
+            INT_TYPE begin = per_thread * i;
+            if (begin >= size) break;
+            INT_TYPE end = i == threads - 1 || size - begin < per_thread ? size : begin + per_thread;
+            workers.emplace_back() = std::thread([&func, i, begin, end]() { func(i, begin, end); });
+        }
+
+        func(0, (INT_TYPE)0, per_thread < size ? per_thread : size);
+
+        for (int i = 0; i < workers.size(); ++i) workers[i].join();
+    }
+
+    // func(T&) on every element, front to back with a sequenced policy, in no particular order otherwise
+    template<class Policy, class Queue, typename Func>
+    if_execution_policy<Policy> for_each(Policy&&, Queue& q, Func func, int threads = 0) {
+        auto pieces = q.segments();
+        auto apply = [&func](auto* data, auto count) {
+            for (decltype(count) i = 0; i < count; ++i) func(data[i]);
+        };
+
+        if constexpr (is_parallel_policy<std::remove_cvref_t<Policy>>::value) {
+            int count = thread_count(pieces.size(), threads);
+            if (count > 1) {
+                using T = std::remove_reference_t<decltype(pieces.first.data[0])>;
+                split_ranges<T>(pieces.size(), count, [&pieces, &apply](int, auto begin, auto end) {
+                    for_each_span(pieces, begin, end, apply);
+                });
+                return;
+            }
+        }
+        for_each_span(pieces, (decltype(pieces.size()))0, pieces.size(), apply);
+    }
+
+    // every element is replaced by func(element)
+    template<class Policy, class Queue, typename Func>
+    if_execution_policy<Policy> transform_inplace(Policy&& policy, Queue& q, Func func, int threads = 0) {
+        nstd::for_each(policy, q, [&func](auto& value) { value = func(value); }, threads);
+    }
+
+    // init combined with every element using op, which has to be associative. the ranges are combined in
+    // order, so it doesn't have to be commutative, but floating point sums can differ from the sequenced one
+    template<class Policy, class Queue, class T, typename FuncOp>
+    if_execution_policy<Policy, T> reduce(Policy&&, const Queue& q, T init, FuncOp op, int threads = 0) {
+        auto pieces = q.segments();
+        if (pieces.size() == 0) return init;
+
+        auto reduce_range = [&pieces, &op](auto begin, auto end) {
+            T result = pieces[begin];
+            for_each_span(pieces, begin + 1, end, [&result, &op](auto* data, auto count) {
+                for (decltype(count) i = 0; i < count; ++i) result = op(result, data[i]);
+            });
+            return result;
+        };
+
+        if constexpr (is_parallel_policy<std::remove_cvref_t<Policy>>::value) {
+            int count = thread_count(pieces.size(), threads);
+            if (count > 1) {
+                using Element = std::remove_reference_t<decltype(pieces.first.data[0])>;
+
+                // each range writes its result once at the end, so these can share cache lines
+                struct partial {
+                    T value = T();
+                    bool used = false;
+                };
+                queue<partial> partials;
+                partials.reserve(count);
+                for (int i = 0; i < count; ++i) partials.emplace_back();
+
+                split_ranges<Element>(pieces.size(), count, [&partials, &reduce_range](int i, auto begin, auto end) {
+                    partials[i].value = reduce_range(begin, end);
+                    partials[i].used = true;
+                });
+
+                for (int i = 0; i < count; ++i) {
+                    if (partials[i].used) init = op(init, partials[i].value);
+                }
+                return init;
+            }
+        }
+        return op(init, reduce_range((decltype(pieces.size()))0, pieces.size()));
+    }
+
+    // sum, the common case
+    template<class Policy, class Queue, class T>
+    if_execution_policy<Policy, T> reduce(Policy&& policy, const Queue& q, T init, int threads = 0) {
+        return nstd::reduce(policy, q, init, [](const T& a, const T& b) { return a + b; }, threads);
+    }
+}
@@ -0,0 +1,220 @@
+#pragma once
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tuple>
+#include <utility>
+#include "queue.hpp"
+
+// a queue of records stored as a structure of arrays: one ring per field, all sharing front_, back_ and capacity_,
+// so element i is column 0 at i, column 1 at i and so on. a consumer that only reads one or two fields of a wide
+// record only pulls those columns through the cache.
+//
+// nstd::queue_soa<int64_t, float, uint32_t> q; // timestamp, price, id
+// q.push_back(t, 1.5f, 7);
+// float total = nstd::sum(q.column<1>()); // with queue_algorithm.hpp, vectorised over one column
+//
+// all the columns grow together (doubling). fields have to be trivial, like queue_trivial
+namespace nstd {
+
+    template <typename INT_TYPE, class... Fields>
+    struct queue_soa_sized {
+        static_assert(std::is_fundamental<INT_TYPE>(), "INT_TYPE is not an integer");
+        static_assert(sizeof...(Fields) > 0, "queue_soa needs at least one field");
+        static_assert((std::is_trivial<Fields>() && ...), "fields in this queue are not trivial when they need to be");
+
+        template<size_t I>
+        using field = std::tuple_element_t<I, std::tuple<Fields...>>;
+
+    private:
+        std::tuple<Fields*...> buffers_;
+        INT_TYPE front_ = 0;
+        INT_TYPE back_ = 0; // back is not inclusive, it is one element after the last element
+        INT_TYPE capacity_ = 0;
+        INT_TYPE size_ = 0;
+
+        // both pieces of one column, unrolled to the start of buffer_new
+        template<size_t I>
+        void move_column(field<I>* buffer_new) noexcept {
+            nstd::segments<field<I>, INT_TYPE> used = column<I>();
+            if (used.first.size > 0) memcpy(buffer_new, used.first.data, sizeof(field<I>) * used.first.size);
+            if (used.second.size > 0) memcpy(buffer_new + used.first.size, used.second.data, sizeof(field<I>) * used.second.size);
+
+            free(std::get<I>(buffers_));
+            std::get<I>(buffers_) = buffer_new;
+        }
+
+        template<size_t... I>
+        void reallocate(INT_TYPE new_capacity, std::index_sequence<I...>) noexcept {
+            assert(new_capacity > size_);
+
+            std::tuple<Fields*...> buffers_new((Fields*)malloc(sizeof(Fields) * new_capacity)...);
+            if (((std::get<I>(buffers_new) == nullptr) || ...)) abort();
+
+            (move_column<I>(std::get<I>(buffers_new)), ...);
+            capacity_ = new_capacity;
+
+            front_ = 0;
+            back_ = size_;
+        }
+
+        void should_reallocate() noexcept {
+            if (capacity_ == size_) {
+                reallocate(capacity_ == 0 ? 2 : capacity_ * 2, std::index_sequence_for<Fields...>());
+            }
+        }
+
+        template<size_t... I>
+        void write(INT_TYPE index, std::index_sequence<I...>, const Fields&... values) noexcept {
+            ((std::get<I>(buffers_)[index] = values), ...);
+        }
+
+    public:
+
+        queue_soa_sized() noexcept {}
+
+        queue_soa_sized(const queue_soa_sized& queue) = delete;
+        queue_soa_sized& operator=(const queue_soa_sized& queue) = delete;
+        queue_soa_sized& operator=(queue_soa_sized&& type) = delete;
+
+        ~queue_soa_sized() {
+            std::apply([](Fields*... buffers) { (free(buffers), ...); }, buffers_);
+        }
+
+        // grows the same way pushing would (doubling) until there is room for count elements
+        void reserve(INT_TYPE count) noexcept {
+            if (count <= capacity_) return;
+
+            INT_TYPE new_capacity = capacity_ == 0 ? 2 : capacity_;
+            while (new_capacity < count) new_capacity *= 2;
+            reallocate(new_capacity, std::index_sequence_for<Fields...>());
+        }
+
+        void clear() noexcept {
+            front_ = 0;
+            back_ = 0;
+            size_ = 0;
+        }
+
+        void push_back(const Fields&... values) noexcept {
+            should_reallocate();
+
+            write(back_, std::index_sequence_for<Fields...>(), values...);
+            back_ = (back_ + 1) % capacity_;
+            ++size_;
+        }
+
+        // room for one more element at the back, left uninitialised. returns its index for get()
+        INT_TYPE emplace_back() noexcept {
+            should_reallocate();
+
+            back_ = (back_ + 1) % capacity_;
+            ++size_;
+            return size_ - 1;
+        }
+
+        void pop() noexcept {
+            assert(size_ != 0);
+
+            front_ = (front_ + 1) % capacity_;
+            --size_;
+        }
+
+        // field I of element i
+        template<size_t I>
+        field<I>& get(INT_TYPE i) noexcept {
+            assert(i >= 0 && i < size_);
+
+            INT_TYPE index_rolling = (front_ + i) % capacity_;
+            return std::get<I>(buffers_)[index_rolling];
+        }
+
+        template<size_t I>
+        const field<I>& get(INT_TYPE i) const noexcept {
+            assert(i >= 0 && i < size_);
+
+            INT_TYPE index_rolling = (front_ + i) % capacity_;
+            return std::get<I>(buffers_)[index_rolling];
+        }
+
+        template<size_t I>
+        field<I>& front() noexcept {
+            assert(size_ != 0);
+
+            return std::get<I>(buffers_)[front_];
+        }
+
+        // every field of element i
+        std::tuple<Fields&...> operator[](INT_TYPE i) noexcept {
+            assert(i >= 0 && i < size_);
+
+            INT_TYPE index_rolling = (front_ + i) % capacity_;
+            return std::apply([index_rolling](Fields*... buffers) { return std::tuple<Fields&...>(buffers[index_rolling]...); }, buffers_);
+        }
+
+        // column I as contiguous pieces: from front_ towards the end of the buffer, then the part that wrapped around
+        template<size_t I>
+        nstd::segments<field<I>, INT_TYPE> column() const noexcept {
+            nstd::segments<field<I>, INT_TYPE> used;
+            if (size_ == 0) return used;
+
+            INT_TYPE first = capacity_ - front_;
+            if (first > size_) first = size_;
+
+            field<I>* buffer = std::get<I>(buffers_);
+            used.first = { buffer + front_, first };
+            used.second = { buffer, size_ - first };
+            return used;
+        }
+
+        // the unused slots of column I, starting at back_. fill every column and then advance_back
+        template<size_t I>
+        nstd::segments<field<I>, INT_TYPE> free_column() const noexcept {
+            nstd::segments<field<I>, INT_TYPE> unused;
+            INT_TYPE count = capacity_ - size_;
+            if (count == 0) return unused;
+
+            INT_TYPE first = capacity_ - back_;
+            if (first > count) first = count;
+
+            field<I>* buffer = std::get<I>(buffers_);
+            unused.first = { buffer + back_, first };
+            unused.second = { buffer, count - first };
+            return unused;
+        }
+
+        // count elements were written into free_column of every column, they are now part of the queue
+        void advance_back(INT_TYPE count) noexcept {
+            assert(count >= 0 && count <= capacity_ - size_);
+            if (count == 0) return;
+
+            back_ = (back_ + count) % capacity_;
+            size_ += count;
+        }
+
+        // count elements from the front are no longer needed (like calling pop count times)
+        void advance_front(INT_TYPE count) noexcept {
+            assert(count >= 0 && count <= size_);
+            if (count == 0) return;
+
+            front_ = (front_ + count) % capacity_;
+            size_ -= count;
+        }
+
+        INT_TYPE capacity() const noexcept {
+            return capacity_;
+        }
+
+        INT_TYPE size() const noexcept {
+            return size_;
+        }
+
+        INT_TYPE empty() const noexcept {
+            return size_ == 0;
+        }
+    };
+
+    // the usual int size type. queue_soa_sized<INT_TYPE, Fields...> for another one, since Fields... has to come last
+    template <class... Fields>
+    using queue_soa = queue_soa_sized<int, Fields...>;
+}
@@ -0,0 +1,228 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <bit>
+#include "queue.hpp"
+
+// how long elements sit in a queue (sojourn time) and how full it is, for capacity planning and for spotting
+// head of line blocking. it's a Policy for queue and queue_trivial:
+//
+// nstd::queue_trivial<Job, int, nstd::queue_sojourn> q;
+// ...
+// q.stats().sojourn().write_json(stdout);
+//
+// every slot gets the time it was pushed in an array next to the buffer, so T doesn't change, and pop puts
+// now minus that time into a histogram. the histograms can be shared between queues (attach) and are lock free,
+// so queues on different threads can report into one. elements thrown away by clear() aren't counted.
+namespace nstd {
+
+    // counts of values in buckets that are powers of two split into 2^step_bits linear steps, so with the default
+    // of 4 steps a value is known to within 25% (32 steps gets it to about 3%).
+    // add() is one relaxed atomic increment and can be called from any thread
+    template<int step_bits>
+    struct basic_log_histogram {
+        static_assert(step_bits >= 1 && step_bits <= 8, "step_bits out of range");
+
+        static constexpr int steps = 1 << step_bits;
+        static constexpr int bucket_count = (65 - step_bits) * steps;
+
+        std::atomic<uint64_t> buckets_[bucket_count] = {};
+        std::atomic<uint64_t> max_{ 0 };
+
+        static int bucket(uint64_t value) noexcept {
+            if (value < 2 * steps) return (int)value;
+            int top = 63 - std::countl_zero(value);
+            int shift = top - step_bits;
+            return (shift + 1) * steps + (int)((value >> shift) & (steps - 1));
+        }
+
+        // largest value that lands in bucket i
+        static uint64_t bucket_top(int i) noexcept {
+            if (i < 2 * steps) return (uint64_t)i;
+            int shift = i / steps - 1;
+            uint64_t low = (uint64_t)(steps + i % steps) << shift;
+            return low + ((uint64_t)1 << shift) - 1;
+        }
+
+        void add(uint64_t value, uint64_t count = 1) noexcept {
+            buckets_[bucket(value)].fetch_add(count, std::memory_order_relaxed);
+
+            uint64_t seen = max_.load(std::memory_order_relaxed);
+            while (value > seen && !max_.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {}
+        }
+
+        uint64_t count() const noexcept {
+            uint64_t total = 0;
+            for (int i = 0; i < bucket_count; ++i) total += buckets_[i].load(std::memory_order_relaxed);
+            return total;
+        }
+
+        uint64_t max() const noexcept {
+            return max_.load(std::memory_order_relaxed);
+        }
+
+        // upper bound of the bucket the percentile falls in, 0 when empty
+        uint64_t percentile(double percent) const noexcept {
+            uint64_t total = count();
+            if (total == 0) return 0;
+
+            uint64_t wanted = (uint64_t)(total * percent / 100.0);
+            if (wanted >= total) wanted = total - 1;
+
+            uint64_t seen = 0;
+            for (int i = 0; i < bucket_count; ++i) {
+                seen += buckets_[i].load(std::memory_order_relaxed);
+                if (seen > wanted) return bucket_top(i) < max() ? bucket_top(i) : max();
+            }
+            return max();
+        }
+
+        void reset() noexcept {
+            for (int i = 0; i < bucket_count; ++i) buckets_[i].store(0, std::memory_order_relaxed);
+            max_.store(0, std::memory_order_relaxed);
+        }
+
+        // not atomic as a whole, nothing should be adding to either while this runs
+        void copy_from(const basic_log_histogram& other) noexcept {
+            for (int i = 0; i < bucket_count; ++i) {
+                buckets_[i].store(other.buckets_[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+            max_.store(other.max(), std::memory_order_relaxed);
+        }
+
+        // one line per non empty bucket: "<= top count"
+        void write_text(FILE* out, const char* unit = "") const {
+            fprintf(out, "count %llu p50 %llu%s p99 %llu%s p99.9 %llu%s max %llu%s\n", (unsigned long long)count(),
+                (unsigned long long)percentile(50), unit, (unsigned long long)percentile(99), unit,
+                (unsigned long long)percentile(99.9), unit, (unsigned long long)max(), unit);
+
+            for (int i = 0; i < bucket_count; ++i) {
+                uint64_t n = buckets_[i].load(std::memory_order_relaxed);
+                if (n != 0) fprintf(out, "<= %llu%s %llu\n", (unsigned long long)bucket_top(i), unit, (unsigned long long)n);
+            }
+        }
+
+        // buckets are [top, count] pairs for the non empty ones
+        void write_json(FILE* out) const {
+            fprintf(out, "{\"count\": %llu, \"p50\": %llu, \"p99\": %llu, \"p99.9\": %llu, \"max\": %llu, \"buckets\": [",
+                (unsigned long long)count(), (unsigned long long)percentile(50), (unsigned long long)percentile(99),
+                (unsigned long long)percentile(99.9), (unsigned long long)max());
+
+            bool first = true;
+            for (int i = 0; i < bucket_count; ++i) {
+                uint64_t n = buckets_[i].load(std::memory_order_relaxed);
+                if (n == 0) continue;
+
+                fprintf(out, "%s[%llu, %llu]", first ? "" : ", ", (unsigned long long)bucket_top(i), (unsigned long long)n);
+                first = false;
+            }
+            fprintf(out, "]}\n");
+        }
+    };
+
+    using log_histogram = basic_log_histogram<2>;
+
+    struct queue_sojourn {
+    private:
+        int64_t* stamps_ = nullptr; // push time of every slot, same layout as the queue's buffer
+        log_histogram own_sojourn_;
+        log_histogram own_occupancy_;
+        log_histogram* sojourn_ = &own_sojourn_;
+        log_histogram* occupancy_ = &own_occupancy_;
+
+        static int64_t now() noexcept {
+            timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+        }
+
+        void take(queue_sojourn& policy) noexcept {
+            stamps_ = policy.stamps_;
+            policy.stamps_ = nullptr;
+
+            own_sojourn_.copy_from(policy.own_sojourn_);
+            own_occupancy_.copy_from(policy.own_occupancy_);
+            sojourn_ = policy.sojourn_ == &policy.own_sojourn_ ? &own_sojourn_ : policy.sojourn_;
+            occupancy_ = policy.occupancy_ == &policy.own_occupancy_ ? &own_occupancy_ : policy.occupancy_;
+        }
+
+    public:
+        queue_sojourn() noexcept {}
+
+        queue_sojourn(const queue_sojourn& policy) = delete;
+        queue_sojourn& operator=(const queue_sojourn& policy) = delete;
+
+        // for queue_trivial::swap, which swaps the policies along with the buffers. the stamps have to follow the
+        // buffer they describe. the own histograms are copied and pointed at again, attached ones stay shared
+        queue_sojourn(queue_sojourn&& policy) noexcept {
+            take(policy);
+        }
+
+        queue_sojourn& operator=(queue_sojourn&& policy) noexcept {
+            if (this != &policy) {
+                free(stamps_);
+                take(policy);
+            }
+            return *this;
+        }
+
+        ~queue_sojourn() {
+            free(stamps_);
+        }
+
+        // report into histograms shared with other queues instead of this queue's own.
+        // they have to outlive the queue
+        void attach(log_histogram* sojourn, log_histogram* occupancy) noexcept {
+            sojourn_ = sojourn != nullptr ? sojourn : &own_sojourn_;
+            occupancy_ = occupancy != nullptr ? occupancy : &own_occupancy_;
+        }
+
+        // ns between push and pop
+        const log_histogram& sojourn() const noexcept {
+            return *sojourn_;
+        }
+
+        // size of the queue after every push
+        const log_histogram& occupancy() const noexcept {
+            return *occupancy_;
+        }
+
+        template<typename INT_TYPE>
+        void on_push(const void*, INT_TYPE slot, INT_TYPE count, INT_TYPE size, INT_TYPE capacity) noexcept {
+            int64_t stamp = now();
+            for (INT_TYPE i = 0; i < count; ++i) {
+                stamps_[(slot + i) % capacity] = stamp;
+            }
+            occupancy_->add((uint64_t)size);
+        }
+
+        template<typename INT_TYPE>
+        void on_pop(const void*, INT_TYPE slot, INT_TYPE count, INT_TYPE, INT_TYPE capacity) noexcept {
+            int64_t stamp = now();
+            for (INT_TYPE i = 0; i < count; ++i) {
+                int64_t waited = stamp - stamps_[(slot + i) % capacity];
+                sojourn_->add(waited > 0 ? (uint64_t)waited : 0);
+            }
+        }
+
+        // the stamps move the same way the elements do, unrolled to start at 0
+        template<typename INT_TYPE>
+        void on_reallocate(const void*, INT_TYPE front, INT_TYPE size, INT_TYPE capacity, INT_TYPE new_capacity, size_t) noexcept {
+            int64_t* stamps_new = (int64_t*)malloc(sizeof(int64_t) * new_capacity);
+            if (stamps_new == nullptr) abort();
+
+            for (INT_TYPE i = 0; i < size; ++i) {
+                stamps_new[i] = stamps_[(front + i) % capacity];
+            }
+
+            free(stamps_);
+            stamps_ = stamps_new;
+        }
+
+        template<typename INT_TYPE> void on_clear(const void*, INT_TYPE) noexcept {}
+    };
+}
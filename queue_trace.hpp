@@ -0,0 +1,67 @@
+#pragma once
+#include <stddef.h>
+#include "queue.hpp"
+
+// USDT (systemtap SDT) probes on the queues, to watch them in production with bpftrace or perf without rebuilding.
+// it's a Policy for queue and queue_trivial:
+//
+// nstd::queue<Job, int, nstd::queue_trace> q;
+//
+// bpftrace -e 'usdt:./server:nstd_queue:reallocate { printf("%p %d -> %d\n", arg0, arg2, arg3); }'
+//
+// probes, provider nstd_queue:
+// push        queue, size, capacity, count
+// pop         queue, size, capacity, count
+// clear       queue, size
+// reallocate  queue, size, capacity, new_capacity
+//
+// a probe nobody is tracing is a single nop in the code. without <sys/sdt.h> (systemtap-sdt-dev on debian) or with
+// NSTD_QUEUE_NO_SDT defined there are no probes at all and the policy is as empty as queue_policy_none.
+// for hooks of your own at compile time write a policy with the same four functions instead.
+#if !defined(NSTD_QUEUE_NO_SDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define NSTD_QUEUE_SDT 1
+#endif
+#endif
+
+namespace nstd {
+
+    struct queue_trace {
+        template<typename INT_TYPE>
+        void on_push(const void* queue, INT_TYPE, INT_TYPE count, INT_TYPE size, INT_TYPE capacity) noexcept {
+#if defined(NSTD_QUEUE_SDT)
+            DTRACE_PROBE4(nstd_queue, push, queue, (long)size, (long)capacity, (long)count);
+#else
+            (void)queue; (void)count; (void)size; (void)capacity;
+#endif
+        }
+
+        template<typename INT_TYPE>
+        void on_pop(const void* queue, INT_TYPE, INT_TYPE count, INT_TYPE size, INT_TYPE capacity) noexcept {
+#if defined(NSTD_QUEUE_SDT)
+            DTRACE_PROBE4(nstd_queue, pop, queue, (long)size, (long)capacity, (long)count);
+#else
+            (void)queue; (void)count; (void)size; (void)capacity;
+#endif
+        }
+
+        template<typename INT_TYPE>
+        void on_reallocate(const void* queue, INT_TYPE, INT_TYPE size, INT_TYPE capacity, INT_TYPE new_capacity, size_t) noexcept {
+#if defined(NSTD_QUEUE_SDT)
+            DTRACE_PROBE4(nstd_queue, reallocate, queue, (long)size, (long)capacity, (long)new_capacity);
+#else
+            (void)queue; (void)size; (void)capacity; (void)new_capacity;
+#endif
+        }
+
+        template<typename INT_TYPE>
+        void on_clear(const void* queue, INT_TYPE size) noexcept {
+#if defined(NSTD_QUEUE_SDT)
+            DTRACE_PROBE2(nstd_queue, clear, queue, (long)size);
+#else
+            (void)queue; (void)size;
+#endif
+        }
+    };
+}
@@ -0,0 +1,207 @@
+#pragma once
+#include <stdint.h>
+#include "queue.hpp"
+
+// variable length records stored inline in one byte ring, instead of a heap allocation per message.
+// each record is a small length header followed by the payload, padded so the next header is aligned.
+//
+// a record is never split over the wrap point (bip buffer): the ring is used as two regions,
+// A from a_start_ to a_end_ and, once the end of the buffer is reached, B from 0 to b_end_ in front of A.
+// new records go after A until there's no room at the end, then after B until it would run into A.
+// when A is drained, B becomes A. so every record is contiguous and front_record() is just a pointer.
+// when neither region has room the buffer doubles, like should_reallocate, and both regions are copied in order.
+namespace nstd {
+
+    template <typename INT_TYPE = int>
+    struct record_queue {
+        static_assert(std::is_fundamental<INT_TYPE>(), "INT_TYPE is not an integer");
+
+    private:
+        struct header {
+            uint32_t size;
+            uint32_t padding;
+        };
+
+        static constexpr INT_TYPE alignment = 8;
+
+        char* buffer_ = nullptr;
+        INT_TYPE capacity_ = 0;
+        INT_TYPE a_start_ = 0;
+        INT_TYPE a_end_ = 0;
+        INT_TYPE b_end_ = 0;
+        bool using_b_ = false;
+        INT_TYPE size_ = 0;
+
+        static INT_TYPE stride(INT_TYPE payload) noexcept {
+            INT_TYPE bytes = (INT_TYPE)sizeof(header) + payload;
+            return (bytes + alignment - 1) / alignment * alignment;
+        }
+
+        INT_TYPE bytes_used() const noexcept {
+            return (a_end_ - a_start_) + (using_b_ ? b_end_ : 0);
+        }
+
+        void reallocate(INT_TYPE needed) noexcept {
+            INT_TYPE used = bytes_used();
+
+            INT_TYPE new_capacity = capacity_ == 0 ? 64 : capacity_ * 2;
+            while (new_capacity < used + needed) new_capacity *= 2;
+
+            char* buffer_new = (char*)malloc(new_capacity);
+            if (buffer_new == nullptr) abort();
+
+            // A is older than B so it goes first
+            INT_TYPE a_bytes = a_end_ - a_start_;
+            if (a_bytes > 0) memcpy(buffer_new, buffer_ + a_start_, a_bytes);
+            if (using_b_ && b_end_ > 0) memcpy(buffer_new + a_bytes, buffer_, b_end_);
+
+            free(buffer_);
+            buffer_ = buffer_new;
+            capacity_ = new_capacity;
+
+            a_start_ = 0;
+            a_end_ = used;
+            b_end_ = 0;
+            using_b_ = false;
+        }
+
+        // finds room for a record of this stride, growing if there isn't any, and returns its offset
+        INT_TYPE allocate(INT_TYPE bytes) noexcept {
+            if (size_ == 0) {
+                a_start_ = 0;
+                a_end_ = 0;
+                b_end_ = 0;
+                using_b_ = false;
+            }
+
+            if (!using_b_) {
+                if (capacity_ - a_end_ >= bytes) {
+                    INT_TYPE offset = a_end_;
+                    a_end_ += bytes;
+                    return offset;
+                }
+
+                // wrap: start B at the beginning of the buffer if it fits in front of A
+                if (a_start_ >= bytes) {
+                    using_b_ = true;
+                    b_end_ = bytes;
+                    return 0;
+                }
+            }
+            else if (a_start_ - b_end_ >= bytes) {
+                INT_TYPE offset = b_end_;
+                b_end_ += bytes;
+                return offset;
+            }
+
+            reallocate(bytes);
+            INT_TYPE offset = a_end_;
+            a_end_ += bytes;
+            return offset;
+        }
+
+    public:
+
+        record_queue() noexcept {}
+
+        record_queue(const record_queue& queue) = delete;
+        record_queue& operator=(const record_queue& queue) = delete;
+
+        ~record_queue() {
+            free(buffer_);
+        }
+
+        // room for a record of size bytes at the back. write the payload into the span
+        span<char, INT_TYPE> emplace_record(INT_TYPE size) noexcept {
+            assert(size >= 0);
+
+            INT_TYPE offset = allocate(stride(size));
+
+            header* h = (header*)(buffer_ + offset);
+            h->size = (uint32_t)size;
+            h->padding = 0;
+            ++size_;
+
+            return { buffer_ + offset + (INT_TYPE)sizeof(header), size };
+        }
+
+        // data can be a record in this queue (pushing front_record() again). making room can move the buffer,
+        // so a pointer into it is rebased to where reallocate put that byte
+        void push_record(const void* data, INT_TYPE size) noexcept {
+            const char* source = (const char*)data;
+            char* buffer_old = buffer_;
+            bool inside = buffer_ != nullptr && source >= buffer_ && source < buffer_ + capacity_;
+            INT_TYPE offset = inside ? (INT_TYPE)(source - buffer_) : 0;
+            INT_TYPE a_start = a_start_;
+            INT_TYPE a_bytes = a_end_ - a_start_;
+
+            span<char, INT_TYPE> record = emplace_record(size);
+
+            // reallocate copies A to the start and B right after it. B is in front of A in the old buffer
+            if (inside && buffer_ != buffer_old) {
+                source = buffer_ + (offset >= a_start ? offset - a_start : a_bytes + offset);
+            }
+            if (size > 0) memcpy(record.data, source, size);
+        }
+
+        void push_record(span<const char, INT_TYPE> record) noexcept {
+            push_record(record.data, record.size);
+        }
+
+        // the oldest record, contiguous
+        span<char, INT_TYPE> front_record() const noexcept {
+            assert(size_ != 0);
+
+            header* h = (header*)(buffer_ + a_start_);
+            return { buffer_ + a_start_ + (INT_TYPE)sizeof(header), (INT_TYPE)h->size };
+        }
+
+        void pop_record() noexcept {
+            assert(size_ != 0);
+
+            header* h = (header*)(buffer_ + a_start_);
+            a_start_ += stride((INT_TYPE)h->size);
+            --size_;
+
+            // A is drained, what was written at the start of the buffer is next
+            if (a_start_ == a_end_) {
+                if (using_b_) {
+                    a_start_ = 0;
+                    a_end_ = b_end_;
+                    b_end_ = 0;
+                    using_b_ = false;
+                }
+                else {
+                    a_start_ = 0;
+                    a_end_ = 0;
+                }
+            }
+        }
+
+        void clear() noexcept {
+            a_start_ = 0;
+            a_end_ = 0;
+            b_end_ = 0;
+            using_b_ = false;
+            size_ = 0;
+        }
+
+        // number of records
+        INT_TYPE size() const noexcept {
+            return size_;
+        }
+
+        bool empty() const noexcept {
+            return size_ == 0;
+        }
+
+        // bytes taken by the records including their headers and padding
+        INT_TYPE bytes() const noexcept {
+            return bytes_used();
+        }
+
+        INT_TYPE capacity() const noexcept {
+            return capacity_;
+        }
+    };
+}
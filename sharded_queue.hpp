@@ -0,0 +1,131 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include "queue.hpp"
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+// a queue split into one shard per core so threads mostly touch their own lock and their own ring.
+// push goes to the shard of the current cpu. pop tries the local shard first and when that is empty
+// it steals a batch from another shard, so the local shard can serve the next few pops by itself.
+// FIFO is only kept per shard, there is no global ordering between elements pushed on different cores.
+namespace nstd {
+
+    template <class T, typename INT_TYPE = int>
+    struct sharded_queue {
+    private:
+        // a cache line each so the locks of neighbouring shards don't false share
+        struct alignas(64) shard {
+            std::mutex mutex_;
+            queue<T, INT_TYPE> items_;
+        };
+
+        shard* shards_ = nullptr;
+        int shard_count_ = 0;
+        INT_TYPE steal_batch_ = 0;
+
+        // fallback when the cpu can't be asked for. threads are spread round robin over the shards
+        static int thread_index() noexcept {
+            static std::atomic<int> next_index{ 0 };
+            thread_local int index = next_index.fetch_add(1, std::memory_order_relaxed);
+            return index;
+        }
+
+        int local_shard() const noexcept {
+#if defined(__linux__)
+            int cpu = sched_getcpu();
+            if (cpu >= 0) return cpu % shard_count_;
+#endif
+            return thread_index() % shard_count_;
+        }
+
+        // moves up to half of the victim's elements (at most steal_batch_) into the local shard
+        // and hands the first one back. both locks are taken together so it can't deadlock.
+        bool steal(shard& local, shard& victim, T& out) {
+            std::scoped_lock lock(local.mutex_, victim.mutex_);
+
+            INT_TYPE available = victim.items_.size();
+            if (available == 0) return false;
+
+            out = std::move(victim.items_.front());
+            victim.items_.pop();
+
+            INT_TYPE take = available / 2;
+            if (take > steal_batch_) take = steal_batch_;
+
+            for (INT_TYPE i = 0; i < take; ++i) {
+                local.items_.push_back(std::move(victim.items_.front()));
+                victim.items_.pop();
+            }
+            return true;
+        }
+
+    public:
+
+        // shard_count == 0 uses one shard per hardware thread
+        explicit sharded_queue(int shard_count = 0, INT_TYPE steal_batch = 32) : steal_batch_(steal_batch) {
+            if (shard_count <= 0) shard_count = (int)std::thread::hardware_concurrency();
+            if (shard_count <= 0) shard_count = 1;
+
+            shard_count_ = shard_count;
+            shards_ = new shard[shard_count_];
+        }
+
+        sharded_queue(const sharded_queue& queue) = delete;
+        sharded_queue& operator=(const sharded_queue& queue) = delete;
+
+        ~sharded_queue() {
+            delete[] shards_;
+        }
+
+        void push_back(const T& data) {
+            shard& local = shards_[local_shard()];
+            std::lock_guard<std::mutex> lock(local.mutex_);
+            local.items_.push_back(data);
+        }
+
+        void push_back(T&& data) {
+            shard& local = shards_[local_shard()];
+            std::lock_guard<std::mutex> lock(local.mutex_);
+            local.items_.push_back(std::move(data));
+        }
+
+        // returns false only when every shard was seen empty
+        bool try_pop(T& out) {
+            int index = local_shard();
+            shard& local = shards_[index];
+
+            {
+                std::lock_guard<std::mutex> lock(local.mutex_);
+                if (!local.items_.empty()) {
+                    out = std::move(local.items_.front());
+                    local.items_.pop();
+                    return true;
+                }
+            }
+
+            for (int i = 1; i < shard_count_; ++i) {
+                shard& victim = shards_[(index + i) % shard_count_];
+                if (steal(local, victim, out)) return true;
+            }
+            return false;
+        }
+
+        // only a snapshot, other threads can change it while it's being added up
+        INT_TYPE size() const {
+            INT_TYPE total = 0;
+            for (int i = 0; i < shard_count_; ++i) {
+                std::lock_guard<std::mutex> lock(shards_[i].mutex_);
+                total += shards_[i].items_.size();
+            }
+            return total;
+        }
+
+        int shard_count() const noexcept {
+            return shard_count_;
+        }
+    };
+}
@@ -0,0 +1,209 @@
+#pragma once
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "queue.hpp"
+
+// a queue_trivial that keeps its memory bounded by spilling the middle of the queue to disk (posix only).
+//
+// the oldest elements are in head_, where the consumer pops, and the newest in tail_, where the producer pushes.
+// once more than memory_limit elements are in memory, the oldest chunk of tail_ is appended to a temporary file,
+// so the order is always head_ -> file -> tail_. when head_ runs out the next chunk is read back from the file,
+// and when there's nothing on disk either the consumer pops straight from tail_.
+// head_ only ever holds one chunk, so the elements in memory stay within memory_limit. the rings grow by doubling,
+// so the buffers behind them can be up to about twice that (tail_'s) plus two chunks (head_'s).
+// both directions move whole chunks with sequential I/O, and after each read the kernel is asked to start reading
+// the following chunk (POSIX_FADV_WILLNEED) so it's in the page cache by the time the consumer gets to it.
+// chunks that have been read back are punched out of the file where that's supported so it doesn't keep growing.
+namespace nstd {
+
+    template <class T, typename INT_TYPE = int>
+    struct spill_queue {
+        static_assert(std::is_fundamental<INT_TYPE>(), "INT_TYPE is not an integer");
+        static_assert(std::is_trivial<T>(), "type in this queue is not trivial when it needs to be");
+
+    private:
+        queue_trivial<T, INT_TYPE> head_;
+        queue_trivial<T, INT_TYPE> tail_;
+
+        char directory_[4096] = {};
+        int fd_ = -1;
+        off_t read_offset_ = 0;
+        off_t write_offset_ = 0;
+        int64_t spilled_ = 0;
+
+        INT_TYPE memory_limit_ = 0;
+        INT_TYPE chunk_ = 0;
+
+        // the file is unlinked as soon as it's created so nothing is left behind if the process dies
+        void open_file() noexcept {
+            char path[4200];
+            snprintf(path, sizeof(path), "%s/nstd_spill_XXXXXX", directory_);
+
+            fd_ = mkstemp(path);
+            if (fd_ < 0) abort();
+            unlink(path);
+        }
+
+        void write_fully(const T* data, INT_TYPE count) noexcept {
+            const char* bytes = (const char*)data;
+            size_t remaining = sizeof(T) * (size_t)count;
+            while (remaining > 0) {
+                ssize_t written = pwrite(fd_, bytes, remaining, write_offset_);
+                if (written < 0 && errno == EINTR) continue;
+                if (written <= 0) abort();
+
+                bytes += written;
+                remaining -= (size_t)written;
+                write_offset_ += written;
+            }
+        }
+
+        void read_fully(T* data, INT_TYPE count) noexcept {
+            char* bytes = (char*)data;
+            size_t remaining = sizeof(T) * (size_t)count;
+            while (remaining > 0) {
+                ssize_t got = pread(fd_, bytes, remaining, read_offset_);
+                if (got < 0 && errno == EINTR) continue;
+                if (got <= 0) abort();
+
+                bytes += got;
+                remaining -= (size_t)got;
+                read_offset_ += got;
+            }
+        }
+
+        // the oldest chunk in tail_ goes to the end of the file
+        void spill() noexcept {
+            if (fd_ < 0) open_file();
+
+            segments<T, INT_TYPE> used = tail_.segments();
+            INT_TYPE first = chunk_ < used.first.size ? chunk_ : used.first.size;
+            write_fully(used.first.data, first);
+            if (chunk_ > first) write_fully(used.second.data, chunk_ - first);
+
+            tail_.advance_front(chunk_);
+            spilled_ += chunk_;
+        }
+
+        // the next chunk from the file goes to the back of head_
+        void unspill() noexcept {
+            INT_TYPE count = spilled_ < chunk_ ? (INT_TYPE)spilled_ : chunk_;
+            off_t chunk_start = read_offset_;
+
+            head_.reserve(head_.size() + count);
+            segments<T, INT_TYPE> room = head_.free_segments();
+            INT_TYPE first = count < room.first.size ? count : room.first.size;
+            read_fully(room.first.data, first);
+            if (count > first) read_fully(room.second.data, count - first);
+            head_.advance_back(count);
+            spilled_ -= count;
+
+            if (spilled_ == 0) {
+                // caught up with the file, start it again from the beginning
+                if (ftruncate(fd_, 0) != 0) abort();
+                read_offset_ = 0;
+                write_offset_ = 0;
+                return;
+            }
+
+#if defined(FALLOC_FL_PUNCH_HOLE)
+            fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, chunk_start, read_offset_ - chunk_start);
+#else
+            (void)chunk_start;
+#endif
+#if defined(POSIX_FADV_WILLNEED)
+            posix_fadvise(fd_, read_offset_, (off_t)(sizeof(T) * (size_t)chunk_), POSIX_FADV_WILLNEED);
+#endif
+        }
+
+        // head_ is empty and nothing is on disk, the oldest chunk of tail_ becomes the head. copied rather than
+        // swapped so tail_ doesn't hand head_ a buffer sized for memory_limit and then grow a second one
+        void take_chunk() noexcept {
+            head_.clear();
+            head_.reserve(chunk_);
+
+            segments<T, INT_TYPE> used = tail_.segments();
+            T* room = head_.free_segments().first.data;
+            INT_TYPE first = chunk_ < used.first.size ? chunk_ : used.first.size;
+            memcpy(room, used.first.data, sizeof(T) * (size_t)first);
+            if (chunk_ > first) memcpy(room + first, used.second.data, sizeof(T) * (size_t)(chunk_ - first));
+
+            head_.advance_back(chunk_);
+            tail_.advance_front(chunk_);
+        }
+
+        // the ring the front element is in: head_, refilled from the file if it ran out, or tail_ if there's
+        // nothing in front of it
+        queue_trivial<T, INT_TYPE>& front_ring() noexcept {
+            if (head_.empty() && spilled_ > 0) unspill();
+            return head_.empty() ? tail_ : head_;
+        }
+
+    public:
+
+        // at most about memory_limit_bytes of elements are kept in memory, the rest goes to a temporary
+        // file in directory (TMPDIR or /tmp if null) in chunks of chunk_bytes
+        explicit spill_queue(size_t memory_limit_bytes = 64 << 20, size_t chunk_bytes = 4 << 20, const char* directory = nullptr) noexcept {
+            if (directory == nullptr) directory = getenv("TMPDIR");
+            if (directory == nullptr) directory = "/tmp";
+            snprintf(directory_, sizeof(directory_), "%s", directory);
+
+            chunk_ = (INT_TYPE)(chunk_bytes / sizeof(T));
+            if (chunk_ < 1) chunk_ = 1;
+            memory_limit_ = (INT_TYPE)(memory_limit_bytes / sizeof(T));
+            if (memory_limit_ < chunk_ * 2) memory_limit_ = chunk_ * 2;
+        }
+
+        spill_queue(const spill_queue& queue) = delete;
+        spill_queue& operator=(const spill_queue& queue) = delete;
+
+        ~spill_queue() {
+            if (fd_ >= 0) close(fd_);
+        }
+
+        void push_back(const T& data) noexcept {
+            tail_.push_back(data);
+
+            // the oldest elements stay in memory for the consumer, it's the middle that goes to disk. so with
+            // nothing in front of tail_ its oldest chunk becomes the head first
+            if (head_.size() + tail_.size() > memory_limit_ && tail_.size() >= chunk_) {
+                if (head_.empty() && spilled_ == 0) take_chunk();
+                if (tail_.size() >= chunk_) spill();
+            }
+        }
+
+        T& front() noexcept {
+            assert(!empty());
+
+            return front_ring().front();
+        }
+
+        void pop() noexcept {
+            assert(!empty());
+
+            front_ring().pop();
+        }
+
+        int64_t size() const noexcept {
+            return (int64_t)head_.size() + spilled_ + tail_.size();
+        }
+
+        bool empty() const noexcept {
+            return size() == 0;
+        }
+
+        // elements currently on disk
+        int64_t spilled() const noexcept {
+            return spilled_;
+        }
+
+        // bytes of the two in memory rings
+        int64_t memory_bytes() const noexcept {
+            return (int64_t)sizeof(T) * ((int64_t)head_.capacity() + tail_.capacity());
+        }
+    };
+}
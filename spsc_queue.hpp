@@ -0,0 +1,146 @@
+#pragma once
+#include <atomic>
+#include "queue.hpp"
+
+// fixed capacity ring for exactly one producer thread and one consumer thread.
+// plain old data only, like queue_trivial, so slots can be handed out as raw memory.
+//
+// front and back are free running counters (masked with capacity - 1 to get a slot) and each side keeps
+// a cached copy of the other side's counter, so it only touches the other cache line when it looks full/empty.
+//
+// besides one-at-a-time try_push/try_pop there is a batched protocol where one release store publishes
+// many elements at once:
+//   producer: claim(n) -> write into the segments -> commit(count)
+//   consumer: peek(n) -> read from the segments -> release(count)
+namespace nstd {
+
+    template <class T>
+    struct spsc_queue {
+        static_assert(std::is_trivially_copyable<T>(), "type in this queue is not trivially copyable when it needs to be");
+
+    private:
+        T* buffer_ = nullptr;
+        size_t capacity_ = 0;
+        size_t mask_ = 0;
+
+        // producer side
+        alignas(64) std::atomic<size_t> back_{ 0 };
+        size_t front_cache_ = 0;
+
+        // consumer side
+        alignas(64) std::atomic<size_t> front_{ 0 };
+        size_t back_cache_ = 0;
+
+        segments<T, size_t> make_segments(size_t start, size_t count) const noexcept {
+            size_t index = start & mask_;
+            size_t first = capacity_ - index;
+            if (first > count) first = count;
+
+            segments<T, size_t> result;
+            result.first = { buffer_ + index, first };
+            result.second = { buffer_, count - first };
+            return result;
+        }
+
+    public:
+
+        // capacity is rounded up to a power of two
+        explicit spsc_queue(size_t capacity) noexcept {
+            capacity_ = 2;
+            while (capacity_ < capacity) capacity_ *= 2;
+            mask_ = capacity_ - 1;
+
+            buffer_ = (T*)malloc(sizeof(T) * capacity_);
+            if (buffer_ == nullptr) abort();
+        }
+
+        spsc_queue(const spsc_queue& queue) = delete;
+        spsc_queue& operator=(const spsc_queue& queue) = delete;
+
+        ~spsc_queue() {
+            free(buffer_);
+        }
+
+        // producer only
+        bool try_push(const T& data) noexcept {
+            size_t back = back_.load(std::memory_order_relaxed);
+            if (back - front_cache_ == capacity_) {
+                front_cache_ = front_.load(std::memory_order_acquire);
+                if (back - front_cache_ == capacity_) return false;
+            }
+
+            buffer_[back & mask_] = data;
+            back_.store(back + 1, std::memory_order_release);
+            return true;
+        }
+
+        // consumer only
+        bool try_pop(T& data) noexcept {
+            size_t front = front_.load(std::memory_order_relaxed);
+            if (front == back_cache_) {
+                back_cache_ = back_.load(std::memory_order_acquire);
+                if (front == back_cache_) return false;
+            }
+
+            data = buffer_[front & mask_];
+            front_.store(front + 1, std::memory_order_release);
+            return true;
+        }
+
+        // producer only. up to n free slots after back, fewer (maybe none) if the ring doesn't have room.
+        // nothing is visible to the consumer until commit
+        segments<T, size_t> claim(size_t n) noexcept {
+            size_t back = back_.load(std::memory_order_relaxed);
+            size_t free_slots = capacity_ - (back - front_cache_);
+            if (free_slots < n) {
+                front_cache_ = front_.load(std::memory_order_acquire);
+                free_slots = capacity_ - (back - front_cache_);
+            }
+            if (n > free_slots) n = free_slots;
+
+            return make_segments(back, n);
+        }
+
+        // producer only. publishes the first n claimed slots with a single release store
+        void commit(size_t n) noexcept {
+            size_t back = back_.load(std::memory_order_relaxed);
+            assert(back + n - front_cache_ <= capacity_);
+            back_.store(back + n, std::memory_order_release);
+        }
+
+        // consumer only. up to n published elements from the front, fewer (maybe none) if there aren't that many
+        segments<T, size_t> peek(size_t n) noexcept {
+            size_t front = front_.load(std::memory_order_relaxed);
+            size_t available = back_cache_ - front;
+            if (available < n) {
+                back_cache_ = back_.load(std::memory_order_acquire);
+                available = back_cache_ - front;
+            }
+            if (n > available) n = available;
+
+            return make_segments(front, n);
+        }
+
+        // consumer only. hands the first n peeked slots back to the producer with a single release store
+        void release(size_t n) noexcept {
+            size_t front = front_.load(std::memory_order_relaxed);
+            assert(front + n <= back_cache_);
+            front_.store(front + n, std::memory_order_release);
+        }
+
+        // exact from either side when the other side is idle, a snapshot otherwise
+        size_t size() const noexcept {
+            size_t front = front_.load(std::memory_order_acquire);
+            size_t back = back_.load(std::memory_order_acquire);
+            return back - front;
+        }
+
+        bool empty() const noexcept {
+            return size() == 0;
+        }
+
+        size_t capacity() const noexcept {
+            return capacity_;
+        }
+    };
+}
@@ -0,0 +1,431 @@
+#pragma once
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "queue.hpp"
+#include "queue_io.hpp"
+
+// a durable queue: every push_back is appended to a write ahead log made of segment files in a directory,
+// and the queue contents are rebuilt from the log when it's opened again (posix only).
+//
+// durability is by group commit. pushes only append to an in memory batch. a flusher thread wakes up at most
+// every window, writes the whole batch with one write and makes it durable with one fdatasync, so all the
+// pushes from that window share a single sync. push_back returns the record's sequence number,
+// durable_sequence() says how far the log is known to be on disk and flush() waits until everything
+// pushed so far is.
+//
+// a failed write, fdatasync or segment rollover on the flusher stops the log for good: the error sticks, nothing
+// after it becomes durable, push_back returns 0 instead of a sequence and flush()/wait_durable() return the
+// negative errno. close and open the log again to recover what made it to disk.
+//
+// consumption is durable too: the sequence of the first element that hasn't been popped is kept in a "head"
+// file, synced with the next group commit, and segments that are entirely before it are deleted.
+// records carry a checksum, a torn record at the end of the last segment is dropped when opening.
+namespace nstd {
+
+    template <class T>
+    struct wal_queue {
+        static_assert(std::is_trivially_copyable<T>(), "type in this queue is not trivially copyable when it needs to be");
+
+    private:
+        struct record {
+            uint64_t sequence;
+            T value;
+            uint64_t checksum; // of everything above
+        };
+
+        static uint64_t record_checksum(const record& r) noexcept {
+            const unsigned char* bytes = (const unsigned char*)&r;
+            uint64_t hash = 14695981039346656037ull;
+            for (size_t i = 0; i < offsetof(record, checksum); ++i) {
+                hash ^= bytes[i];
+                hash *= 1099511628211ull;
+            }
+            return hash;
+        }
+
+        char directory_[4096] = {};
+        int directory_fd_ = -1;
+        int segment_fd_ = -1;
+        int head_fd_ = -1;
+        size_t segment_bytes_ = 0;
+        size_t segment_limit_ = 0;
+        std::chrono::microseconds window_;
+
+        // first sequence of every segment file still on disk, oldest at the front
+        queue_trivial<uint64_t> segment_firsts_;
+
+        std::mutex mutex_;
+        std::condition_variable flusher_wake_;
+        std::condition_variable durable_changed_;
+        std::thread flusher_;
+        bool stop_ = false;
+        bool flush_requested_ = false;
+
+        // all of these are guarded by mutex_
+        queue<T> items_;
+        queue_trivial<char> pending_;
+        uint64_t next_sequence_ = 1;
+        uint64_t head_sequence_ = 1; // sequence of items_.front()
+        uint64_t durable_sequence_ = 0;
+        uint64_t durable_head_ = 0;
+        int error_ = 0; // sticky, the first failure of the flusher
+
+        void segment_path(char* path, size_t size, uint64_t first) const noexcept {
+            snprintf(path, size, "%s/%020llu.wal", directory_, (unsigned long long)first);
+        }
+
+        static void append(queue_trivial<char>& bytes, const void* data, int count) noexcept {
+            bytes.reserve(bytes.size() + count);
+
+            segments<char, int> room = bytes.free_segments();
+            int first = count < room.first.size ? count : room.first.size;
+            memcpy(room.first.data, data, first);
+            if (count > first) memcpy(room.second.data, (const char*)data + first, count - first);
+            bytes.advance_back(count);
+        }
+
+        // a new file in the directory only survives a crash once the directory itself is synced
+        int open_segment(uint64_t first) noexcept {
+            char path[4200];
+            segment_path(path, sizeof(path), first);
+
+            int fd = ::open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            if (fd < 0) return -errno;
+            if (fsync(directory_fd_) != 0) {
+                int error = -errno;
+                ::close(fd);
+                return error;
+            }
+
+            if (segment_fd_ >= 0) ::close(segment_fd_);
+            segment_fd_ = fd;
+            segment_bytes_ = 0;
+            segment_firsts_.push_back(first);
+            return 0;
+        }
+
+        // reads one segment, pushing the records that haven't been popped yet. valid is set to the length of the
+        // valid prefix of the file. returns 0 or a negative errno, a segment that can't be read is not torn.
+        // only the last segment can have a torn tail (a group commit that never finished), a bad or out of order
+        // record anywhere else is -EBADMSG rather than a reason to drop everything after it
+        int replay_segment(const char* path, bool last, off_t& valid) noexcept {
+            valid = 0;
+            int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+            if (fd < 0) return -errno;
+
+            record r;
+            while (true) {
+                ssize_t got = pread(fd, &r, sizeof(r), valid);
+                if (got < 0 && errno == EINTR) continue;
+                if (got < 0) {
+                    int error = -errno;
+                    ::close(fd);
+                    return error;
+                }
+                if (got == 0) break;
+
+                bool good = got == (ssize_t)sizeof(r) && r.checksum == record_checksum(r) && r.sequence == next_sequence_;
+                if (!good) {
+                    ::close(fd);
+                    return last ? 0 : -EBADMSG;
+                }
+
+                if (r.sequence >= head_sequence_) items_.push_back(r.value);
+                next_sequence_ = r.sequence + 1;
+                valid += sizeof(r);
+            }
+
+            ::close(fd);
+            return 0;
+        }
+
+        void flusher_loop() {
+            queue_trivial<char> writing;
+            std::unique_lock<std::mutex> lock(mutex_);
+
+            while (!stop_ && error_ == 0) {
+                flusher_wake_.wait(lock, [this]() { return stop_ || pending_.size() > 0 || head_sequence_ != durable_head_; });
+
+                // give the window for more pushes to join this commit, unless someone is waiting on flush()
+                if (!flush_requested_ && !stop_) {
+                    flusher_wake_.wait_for(lock, window_, [this]() { return stop_ || flush_requested_; });
+                }
+                flush_requested_ = false;
+
+                // take the batch, the next one fills up while this one is being synced
+                writing.swap(pending_);
+                uint64_t last = next_sequence_ - 1;
+                uint64_t head = head_sequence_;
+                lock.unlock();
+
+                int error = commit(writing, last, head);
+
+                lock.lock();
+                if (error != 0) {
+                    error_ = error;
+                }
+                else {
+                    durable_sequence_ = last;
+                    durable_head_ = head;
+                }
+                durable_changed_.notify_all();
+            }
+        }
+
+        // runs on the flusher thread without the lock, only the flusher touches the files after open().
+        // returns 0 or a negative errno
+        int commit(queue_trivial<char>& writing, uint64_t last, uint64_t head) noexcept {
+            if (writing.size() > 0) {
+                segment_bytes_ += writing.size();
+                while (!writing.empty()) {
+                    ssize_t written = write_to_fd(writing, segment_fd_);
+                    if (written < 0) return -errno;
+                }
+                if (fdatasync(segment_fd_) != 0) return -errno;
+            }
+
+            if (head != durable_head_) {
+                ssize_t written = pwrite(head_fd_, &head, sizeof(head), 0);
+                if (written < 0) return -errno;
+                if (written != (ssize_t)sizeof(head)) return -EIO;
+                if (fdatasync(head_fd_) != 0) return -errno;
+
+                // segments that end before the head aren't needed anymore. the current one is always kept
+                while (segment_firsts_.size() > 1 && segment_firsts_[1] <= head) {
+                    char path[4200];
+                    segment_path(path, sizeof(path), segment_firsts_.front());
+                    unlink(path);
+                    segment_firsts_.pop();
+                }
+            }
+
+            if (segment_bytes_ >= segment_limit_) return open_segment(last + 1);
+            return 0;
+        }
+
+    public:
+
+        // pushes from one window of time are synced together. segments roll over at about segment_limit bytes
+        explicit wal_queue(std::chrono::microseconds window = std::chrono::microseconds(1000), size_t segment_limit = 64 << 20) noexcept
+            : segment_limit_(segment_limit), window_(window) {}
+
+        wal_queue(const wal_queue& queue) = delete;
+        wal_queue& operator=(const wal_queue& queue) = delete;
+
+        ~wal_queue() {
+            close();
+        }
+
+        // opens (or creates) the log in directory and rebuilds the queue from it.
+        // returns 0 or a negative errno
+        int open(const char* directory) noexcept {
+            assert(directory_fd_ < 0);
+
+            snprintf(directory_, sizeof(directory_), "%s", directory);
+            mkdir(directory_, 0755);
+
+            directory_fd_ = ::open(directory_, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (directory_fd_ < 0) return -errno;
+
+            char path[4200];
+            snprintf(path, sizeof(path), "%s/head", directory_);
+            head_fd_ = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+            if (head_fd_ < 0) {
+                int error = -errno;
+                close();
+                return error;
+            }
+
+            uint64_t head = 0;
+            if (pread(head_fd_, &head, sizeof(head), 0) == (ssize_t)sizeof(head) && head > 0) head_sequence_ = head;
+
+            // segment files sorted by the first sequence in them, which is their name
+            queue_trivial<uint64_t> firsts;
+            DIR* listing = opendir(directory_);
+            if (listing == nullptr) {
+                int error = -errno;
+                close();
+                return error;
+            }
+            while (dirent* entry = readdir(listing)) {
+                unsigned long long first = 0;
+                char suffix[8] = {};
+                if (sscanf(entry->d_name, "%20llu.%3s", &first, suffix) == 2 && strcmp(suffix, "wal") == 0) firsts.push_back(first);
+            }
+            closedir(listing);
+            std::sort(firsts.buffer_, firsts.buffer_ + firsts.size());
+
+            if (firsts.size() > 0) next_sequence_ = firsts[0];
+            if (head_sequence_ < next_sequence_) head_sequence_ = next_sequence_;
+
+            for (int i = 0; i < firsts.size(); ++i) {
+                // a segment starts where the one before it left off, a gap means one went missing
+                if (firsts[i] != next_sequence_) {
+                    close();
+                    return -EBADMSG;
+                }
+
+                segment_path(path, sizeof(path), firsts[i]);
+                off_t valid;
+                int error = replay_segment(path, i == firsts.size() - 1, valid);
+                if (error != 0) {
+                    close();
+                    return error;
+                }
+
+                // cut a torn record off the end so new records follow the last good one.
+                // the last segment is pushed to segment_firsts_ when it's opened for appending below
+                if (i == firsts.size() - 1) {
+                    if (truncate(path, valid) != 0) {
+                        int error = -errno;
+                        close();
+                        return error;
+                    }
+                }
+                else {
+                    segment_firsts_.push_back(firsts[i]);
+                }
+            }
+            durable_sequence_ = next_sequence_ - 1;
+            durable_head_ = head_sequence_;
+
+            // keep appending to the last segment if there is one
+            int error;
+            if (firsts.empty()) {
+                error = open_segment(next_sequence_);
+            }
+            else {
+                error = open_segment(firsts[firsts.size() - 1]);
+                struct stat info;
+                if (error == 0 && fstat(segment_fd_, &info) == 0) segment_bytes_ = (size_t)info.st_size;
+            }
+            if (error != 0) {
+                close();
+                return error;
+            }
+
+            stop_ = false;
+            error_ = 0;
+            flusher_ = std::thread([this]() { flusher_loop(); });
+            return 0;
+        }
+
+        // flushes what's left and closes the files. everything in memory goes too, the queue is empty until the
+        // next open() rebuilds it from the log
+        void close() noexcept {
+            if (flusher_.joinable()) {
+                flush();
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    stop_ = true;
+                }
+                flusher_wake_.notify_one();
+                flusher_.join();
+            }
+
+            if (segment_fd_ >= 0) ::close(segment_fd_);
+            if (head_fd_ >= 0) ::close(head_fd_);
+            if (directory_fd_ >= 0) ::close(directory_fd_);
+            segment_fd_ = -1;
+            head_fd_ = -1;
+            directory_fd_ = -1;
+
+            segment_bytes_ = 0;
+            segment_firsts_.clear();
+            stop_ = false;
+            flush_requested_ = false;
+            items_.clear();
+            pending_.clear();
+            next_sequence_ = 1;
+            head_sequence_ = 1;
+            durable_sequence_ = 0;
+            durable_head_ = 0;
+            error_ = 0;
+        }
+
+        // returns the sequence number of the record, durable once durable_sequence() reaches it.
+        // 0 if the log has failed, error() says why
+        uint64_t push_back(const T& data) noexcept {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (error_ != 0) return 0;
+
+            record r;
+            memset(&r, 0, sizeof(r));
+            r.sequence = next_sequence_++;
+            r.value = data;
+            r.checksum = record_checksum(r);
+            append(pending_, &r, sizeof(r));
+
+            items_.push_back(data);
+            if (pending_.size() == (int)sizeof(r)) flusher_wake_.notify_one();
+            return r.sequence;
+        }
+
+        // false if the queue is empty. the pop is made durable with the next group commit
+        bool try_pop(T& data) noexcept {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (items_.empty()) return false;
+
+            data = items_.front();
+            items_.pop();
+            ++head_sequence_;
+            flusher_wake_.notify_one();
+            return true;
+        }
+
+        // every record pushed up to now is on disk
+        uint64_t durable_sequence() noexcept {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return durable_sequence_;
+        }
+
+        // 0 or the negative errno the log failed with
+        int error() noexcept {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return error_;
+        }
+
+        // waits for sequence to be durable. returns 0, or the error if the log failed before it got there
+        int wait_durable(uint64_t sequence) noexcept {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (durable_sequence_ >= sequence) return 0;
+            if (error_ != 0) return error_;
+
+            flush_requested_ = true;
+            flusher_wake_.notify_one();
+            durable_changed_.wait(lock, [this, sequence]() { return durable_sequence_ >= sequence || error_ != 0; });
+            return durable_sequence_ >= sequence ? 0 : error_;
+        }
+
+        // waits until everything pushed and popped so far is durable, without waiting out the window.
+        // returns 0, or the error if the log failed before it got there
+        int flush() noexcept {
+            std::unique_lock<std::mutex> lock(mutex_);
+            uint64_t last = next_sequence_ - 1;
+            uint64_t head = head_sequence_;
+            if (durable_sequence_ >= last && durable_head_ == head) return 0;
+            if (error_ != 0) return error_;
+
+            flush_requested_ = true;
+            flusher_wake_.notify_one();
+            durable_changed_.wait(lock, [this, last, head]() { return (durable_sequence_ >= last && durable_head_ >= head) || error_ != 0; });
+            return durable_sequence_ >= last && durable_head_ >= head ? 0 : error_;
+        }
+
+        int size() noexcept {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return items_.size();
+        }
+    };
+}
@@ -0,0 +1,187 @@
+// checks wal_queue recovery: reopening the same object, a torn tail in the last segment and a corrupt record in an
+// earlier segment. posix only:
+// g++ -O2 -std=c++20 -pthread wal_test.cpp -o wal_test
+// ./wal_test
+//
+// the logs go in fresh directories under /tmp which are removed afterwards. exits with 1 if anything didn't match.
+#include <dirent.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "wal_queue.hpp"
+
+using wal = nstd::wal_queue<int64_t>;
+
+static int failures = 0;
+
+static void Check(bool ok, const char* test, const char* what) {
+	if (ok) return;
+	printf("FAIL %s: %s\n", test, what);
+	++failures;
+}
+
+static bool MakeDirectory(char* directory) {
+	if (mkdtemp(directory) != nullptr) return true;
+	printf("FAIL can't make a directory under /tmp\n");
+	++failures;
+	return false;
+}
+
+static void RemoveDirectory(const char* directory) {
+	char command[64];
+	snprintf(command, sizeof(command), "rm -rf %s", directory);
+	if (system(command) != 0) printf("couldn't remove %s\n", directory);
+}
+
+// pops everything and checks it's first, first + 1, ... first + count - 1
+static bool PopsInOrder(wal& q, int64_t first, int count) {
+	int64_t value;
+	for (int i = 0; i < count; i++) {
+		if (!q.try_pop(value) || value != first + i) return false;
+	}
+	return !q.try_pop(value);
+}
+
+// path of the segment file with the lowest (last false) or highest (last true) name
+static bool SegmentPath(const char* directory, bool last, char* path, size_t size) {
+	unsigned long long chosen = 0;
+	bool found = false;
+
+	DIR* listing = opendir(directory);
+	if (listing == nullptr) return false;
+	while (dirent* entry = readdir(listing)) {
+		unsigned long long first = 0;
+		char suffix[8] = {};
+		if (sscanf(entry->d_name, "%20llu.%3s", &first, suffix) != 2 || strcmp(suffix, "wal") != 0) continue;
+		if (!found || (last ? first > chosen : first < chosen)) chosen = first;
+		found = true;
+	}
+	closedir(listing);
+
+	snprintf(path, size, "%s/%020llu.wal", directory, chosen);
+	return found;
+}
+
+// close and open on the same object has to start from what's on disk, not add the log to what was in memory
+static void TestReopenSameObject() {
+	const char* test = "reopen";
+	char directory[] = "/tmp/nstd_wal_test_XXXXXX";
+	if (!MakeDirectory(directory)) return;
+
+	{
+		wal q;
+		Check(q.open(directory) == 0, test, "open");
+		for (int i = 0; i < 5; i++) q.push_back(i);
+		Check(q.flush() == 0, test, "flush");
+		q.close();
+
+		Check(q.open(directory) == 0, test, "open again");
+		Check(q.size() == 5, test, "size after reopening");
+		Check(PopsInOrder(q, 0, 5), test, "pops after reopening");
+
+		q.push_back(5);
+		Check(q.flush() == 0, test, "flush after reopening");
+	}
+
+	wal fresh;
+	Check(fresh.open(directory) == 0, test, "open with a new object");
+	Check(fresh.size() == 1, test, "size with a new object");
+	Check(PopsInOrder(fresh, 5, 1), test, "the push after reopening was lost");
+	fresh.close();
+
+	RemoveDirectory(directory);
+}
+
+// a record cut short at the end of the last segment is a commit that never finished, it's dropped
+static void TestTornTail() {
+	const char* test = "torn tail";
+	char directory[] = "/tmp/nstd_wal_test_XXXXXX";
+	if (!MakeDirectory(directory)) return;
+
+	{
+		wal q;
+		Check(q.open(directory) == 0, test, "open");
+		for (int i = 0; i < 10; i++) q.push_back(i);
+		Check(q.flush() == 0, test, "flush");
+	}
+
+	char path[4200];
+	struct stat info;
+	Check(SegmentPath(directory, true, path, sizeof(path)) && stat(path, &info) == 0, test, "find the segment");
+	Check(truncate(path, info.st_size - 5) == 0, test, "truncate");
+
+	{
+		wal q;
+		Check(q.open(directory) == 0, test, "open with a torn tail");
+		Check(q.size() == 9, test, "size with a torn tail");
+		q.push_back(100);
+		Check(q.flush() == 0, test, "flush after the torn tail");
+	}
+
+	wal q;
+	Check(q.open(directory) == 0, test, "open after appending");
+	int64_t value = -1;
+	for (int i = 0; i < 9; i++) q.try_pop(value);
+	Check(value == 8 && q.try_pop(value) && value == 100, test, "appended after the last good record");
+	q.close();
+
+	RemoveDirectory(directory);
+}
+
+// a bad record in a segment that isn't the last one is corruption, not a torn tail. open fails and leaves the
+// files alone instead of dropping every segment after it
+static void TestCorruptMiddleSegment() {
+	const char* test = "corrupt segment";
+	char directory[] = "/tmp/nstd_wal_test_XXXXXX";
+	if (!MakeDirectory(directory)) return;
+
+	{
+		wal q(std::chrono::microseconds(100), 256);
+		Check(q.open(directory) == 0, test, "open");
+		for (int i = 0; i < 100; i++) {
+			q.push_back(i);
+			if (i % 10 == 9) Check(q.flush() == 0, test, "flush");
+		}
+	}
+
+	char first[4200];
+	char last[4200];
+	Check(SegmentPath(directory, false, first, sizeof(first)), test, "find the first segment");
+	Check(SegmentPath(directory, true, last, sizeof(last)) && strcmp(first, last) != 0, test, "more than one segment");
+
+	struct stat before;
+	Check(stat(last, &before) == 0, test, "stat the last segment");
+
+	FILE* file = fopen(first, "r+b");
+	Check(file != nullptr, test, "open the first segment");
+	if (file != nullptr) {
+		fseek(file, 30, SEEK_SET);
+		fputc(0x5a, file);
+		fclose(file);
+	}
+
+	wal q;
+	Check(q.open(directory) == -EBADMSG, test, "open didn't report the corruption");
+
+	struct stat after;
+	Check(stat(last, &after) == 0 && after.st_size == before.st_size, test, "the last segment was changed");
+
+	RemoveDirectory(directory);
+}
+
+int main() {
+	TestReopenSameObject();
+	TestTornTail();
+	TestCorruptMiddleSegment();
+
+	if (failures > 0) {
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("all passed\n");
+	return 0;
+}
@@ -0,0 +1,140 @@
+#pragma once
+#include <stdint.h>
+#include <limits>
+#include "queue.hpp"
+
+// a sliding window aggregate (sum, product, min, max or any monoid) over the last N values or the last T seconds,
+// updated in amortised O(1) per push and evict instead of recomputing the whole window.
+//
+// it's the two-stacks-lite algorithm on a single ring: the front part of the queue holds partial aggregates, each
+// slot the aggregate of itself and everything after it up to the boundary, and the values pushed since are folded
+// into one running back aggregate. the window is front slot + back aggregate. when the front part runs out the
+// whole queue is turned into partial aggregates in one pass from the back, so every value is folded at most twice.
+// op doesn't have to be commutative, just associative.
+//
+// nstd::window_aggregator<double, nstd::window_sum<double>> sums;
+// sums.push_back(x);
+// if (sums.size() > 1000) sums.evict();
+// double total = sums.query();
+//
+// Op is a struct with T identity() and T operator()(const T& older, const T& newer)
+namespace nstd {
+
+    template <class T>
+    struct window_sum {
+        T identity() const noexcept { return T(); }
+        T operator()(const T& a, const T& b) const noexcept { return a + b; }
+    };
+
+    template <class T>
+    struct window_product {
+        T identity() const noexcept { return T(1); }
+        T operator()(const T& a, const T& b) const noexcept { return a * b; }
+    };
+
+    // identity is the largest value T has, query() on an empty window returns it.
+    // pass another limit for types without numeric_limits: window_min<T>{ limit }
+    template <class T>
+    struct window_min {
+        T limit = std::numeric_limits<T>::max();
+        T identity() const noexcept { return limit; }
+        T operator()(const T& a, const T& b) const noexcept { return b < a ? b : a; }
+    };
+
+    // identity is the lowest value T has
+    template <class T>
+    struct window_max {
+        T limit = std::numeric_limits<T>::lowest();
+        T identity() const noexcept { return limit; }
+        T operator()(const T& a, const T& b) const noexcept { return a < b ? b : a; }
+    };
+
+    template <class T, class Op, class Key = int64_t>
+    struct window_aggregator {
+    private:
+        queue<T> values_;         // partial aggregates for the first front_count_, plain values after that
+        queue_trivial<Key> keys_; // only for the keyed push_back
+        T back_;                  // aggregate of the plain values
+        int front_count_ = 0;
+        Op op_;
+
+        // turns every value into the aggregate of itself and everything after it
+        void flip() {
+            nstd::segments<T, int> all = values_.segments();
+
+            T running = op_.identity();
+            for (int i = all.second.size - 1; i >= 0; --i) {
+                running = op_(all.second.data[i], running);
+                all.second.data[i] = running;
+            }
+            for (int i = all.first.size - 1; i >= 0; --i) {
+                running = op_(all.first.data[i], running);
+                all.first.data[i] = running;
+            }
+
+            front_count_ = values_.size();
+            back_ = op_.identity();
+        }
+
+    public:
+
+        explicit window_aggregator(Op op = Op()) : op_(op) {
+            back_ = op_.identity();
+        }
+
+        window_aggregator(const window_aggregator& window) = delete;
+        window_aggregator& operator=(const window_aggregator& window) = delete;
+
+        void push_back(const T& value) {
+            back_ = op_(back_, value);
+            values_.push_back(value);
+        }
+
+        // the oldest value leaves the window
+        void evict() {
+            assert(!values_.empty());
+
+            if (front_count_ == 0) flip();
+            values_.pop();
+            --front_count_;
+        }
+
+        // the aggregate of everything in the window, identity when it's empty
+        T query() const {
+            if (front_count_ == 0) return back_;
+            return op_(values_.segments()[0], back_);
+        }
+
+        // for time windows: the key goes with the value, keys have to be pushed in order.
+        // don't mix with the push_back without a key on the same window
+        void push_back(const Key& key, const T& value) {
+            keys_.push_back(key);
+            push_back(value);
+        }
+
+        // evicts everything pushed with a key before oldest
+        void evict_before(const Key& oldest) {
+            assert(keys_.size() == values_.size());
+
+            while (!keys_.empty() && keys_.front() < oldest) {
+                keys_.pop();
+                evict();
+            }
+        }
+
+        int size() const noexcept {
+            return values_.size();
+        }
+
+        bool empty() const noexcept {
+            return values_.empty();
+        }
+
+        void clear() {
+            values_.clear();
+            keys_.clear();
+            front_count_ = 0;
+            back_ = op_.identity();
+        }
+    };
+}